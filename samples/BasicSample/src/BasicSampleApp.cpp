@@ -20,6 +20,7 @@ public:
 
 protected:
 	StyledTextLayoutRef mTextLayout;
+	Surface8u mTextSurface;
 	gl::TextureRef mTextTexture;
 };
 
@@ -64,12 +65,13 @@ void BasicSampleApp::update() {
 	mTextLayout->setMaxWidth(winMousePos.x);
 
 	if (mTextLayout->hasChanges()) {
-		auto surface = mTextLayout->renderToSurface();
+		// re-uses the existing surface unless the text size changed
+		mTextLayout->renderToSurface(mTextSurface);
 
-		if (mTextTexture && mTextTexture->getSize() == surface.getSize()) {
-			mTextTexture->update(surface);
+		if (mTextTexture && mTextTexture->getSize() == mTextSurface.getSize()) {
+			mTextTexture->update(mTextSurface);
 		} else {
-			mTextTexture = gl::Texture::create(surface);
+			mTextTexture = gl::Texture::create(mTextSurface);
 		}
 	}
 }
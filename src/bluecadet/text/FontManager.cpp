@@ -11,9 +11,11 @@ namespace bluecadet {
 namespace text {
 
 FontManager::FontManager()
-	: mDefaultName("Arial"),
+	: mCache(std::make_shared<Cache>()),
+	  mDefaultName("Arial"),
 	  mDefaultStyle(FontStyle::Normal),
 	  mDefaultWeight(FontWeight::Regular),
+	  mFontScale(1.0f),
 	  mLogLevel(LogLevel::Error) {}
 
 FontManager::~FontManager() {}
@@ -42,6 +44,7 @@ void FontManager::setup(ci::fs::path jsonPath) {
 
 		JsonTree json = JsonTree(jsonData);
 		std::string jsonDirPath = jsonPath.remove_filename().string();
+		WeightsByFamily weightsByFamily;
 
 		auto & familiesJson = json.getChild("fonts").getChildren();
 
@@ -66,9 +69,18 @@ void FontManager::setup(ci::fs::path jsonPath) {
 				styles[weight] = filePaths;
 			}
 
-			mWeightsByFamily[familyJson.getKey()] = styles;
+			weightsByFamily[familyJson.getKey()] = styles;
 		}
 
+		// publish all families at once
+		lock_guard<mutex> lock(mCacheMutex);
+		auto cache = make_shared<Cache>(*getCache());
+		for (auto & family : weightsByFamily) {
+			cache->mWeightsByFamily[family.first] = family.second;
+		}
+		cache->mResolvedFonts.clear();
+		setCache(cache);
+
 	} catch (const std::exception & e) {
 		if (mLogLevel >= LogLevel::Error) {
 			CI_LOG_EXCEPTION("FontManager: Error: Could not parse JSON: ", e);
@@ -76,15 +88,101 @@ void FontManager::setup(ci::fs::path jsonPath) {
 	}
 }
 
-ci::Font & FontManager::getFont(Style style, FallbackMode fallbackMode) {
+void FontManager::setDefaultName(const std::string value) {
+	lock_guard<mutex> lock(mCacheMutex);
+	mDefaultName = value;
+	clearResolvedFonts();
+}
+
+void FontManager::setDefaultStyle(const FontStyle value) {
+	lock_guard<mutex> lock(mCacheMutex);
+	mDefaultStyle = value;
+	clearResolvedFonts();
+}
+
+ci::Font & FontManager::getFont(const Style & style, FallbackMode fallbackMode) {
 	return getFont(style.mFontFamily, style.mFontSize, style.mFontWeight, style.mFontStyle, fallbackMode);
 }
 
 ci::Font & FontManager::getFont(std::string family, float size, int weight, FontStyle style,
 								FallbackMode fallbackMode) {
-	auto weightsIt = mWeightsByFamily.find(family);
+	const ResolvedFontKey key(family, size, weight, style, fallbackMode);
+
+	// Fast path: font has been resolved before
+	{
+		const auto cache = getCache();
+		const auto fontIt = cache->mResolvedFonts.find(key);
+		if (fontIt != cache->mResolvedFonts.end()) {
+			return *fontIt->second;
+		}
+	}
+
+	// Slow path: resolve and load font on a copy of the cache
+	lock_guard<mutex> lock(mCacheMutex);
+	auto cache = make_shared<Cache>(*getCache());
+	auto & font = cache->mResolvedFonts[key];
+
+	if (!font) {
+		font = resolveFont(*cache, family, size, weight, style, fallbackMode);
+		setCache(cache);
+	}
+
+	return *font;
+}
+
+ci::Font & FontManager::getCachedFontByPath(std::string path, float size) {
+	{
+		const auto cache = getCache();
+		const auto fontIt = cache->mFontsByKey.find(FontKey(path, size));
+		if (fontIt != cache->mFontsByKey.end()) {
+			return *fontIt->second;
+		}
+	}
+
+	lock_guard<mutex> lock(mCacheMutex);
+	auto cache = make_shared<Cache>(*getCache());
+	auto font = loadFontByPath(*cache, path, size);
+	setCache(cache);
+	return *font;
+}
+
+ci::Font & FontManager::getCachedFontByName(std::string name, float size) {
+	{
+		const auto cache = getCache();
+		const auto fontIt = cache->mFontsByKey.find(FontKey(name, size));
+		if (fontIt != cache->mFontsByKey.end()) {
+			return *fontIt->second;
+		}
+	}
+
+	lock_guard<mutex> lock(mCacheMutex);
+	auto cache = make_shared<Cache>(*getCache());
+	auto font = loadFontByName(*cache, name, size);
+	setCache(cache);
+	return *font;
+}
+
+FontManager::CacheRef FontManager::getCache() const {
+	return std::atomic_load(&mCache);
+}
+
+void FontManager::setCache(CacheRef cache) {
+	std::atomic_store(&mCache, cache);
+}
+
+void FontManager::clearResolvedFonts() {
+	auto cache = make_shared<Cache>(*getCache());
+	cache->mResolvedFonts.clear();
+	setCache(cache);
+}
+
+FontManager::FontRef FontManager::resolveFont(Cache & cache, const std::string & family, float size, int weight,
+											  FontStyle style, FallbackMode fallbackMode) {
+	auto weightsIt = cache.mWeightsByFamily.find(family);
+
+	if (weightsIt == cache.mWeightsByFamily.end()) {
+		std::string fontName = family;
 
-	if (weightsIt == mWeightsByFamily.end()) {
 		// Check if we have the font family as a system font
 		auto & systemFontNames = Font::getNames();
 		auto fontIt = std::find(systemFontNames.begin(), systemFontNames.end(), family);
@@ -99,9 +197,9 @@ ci::Font & FontManager::getFont(std::string family, float size, int weight, Font
 							 << family << "'; Returning default font '" << mDefaultName << "'");
 				}
 			}
-			family = mDefaultName;
+			fontName = mDefaultName;
 		}
-		return getCachedFontByName(family, size);
+		return loadFontByName(cache, fontName, size);
 	}
 
 	string path = getFontPath(weightsIt->second, weight, style, fallbackMode);
@@ -115,13 +213,58 @@ ci::Font & FontManager::getFont(std::string family, float size, int weight, Font
 					 << to_string(weight) << "' and style '" << getStringFromFontStyle(style) << "' for family '"
 					 << family << "'; Returning default font '" << mDefaultName << "'");
 		}
-		return getCachedFontByName(mDefaultName, size);
+		return loadFontByName(cache, mDefaultName, size);
 	}
 
-	return getCachedFontByPath(path, size);
+	return loadFontByPath(cache, path, size);
 }
 
-std::string FontManager::getFontPath(StylesByWeight & weights, int targetWeight, FontStyle targetStyle,
+FontManager::FontRef FontManager::loadFontByPath(Cache & cache, const std::string & path, float size) {
+	auto & font = cache.mFontsByKey[FontKey(path, size)];
+
+	if (!font) {
+		ci::DataSourceRef dataSource = nullptr;
+
+		// try loading font file
+		try {
+			dataSource = loadFile(path);
+		} catch (Exception e) {
+			if (mLogLevel >= LogLevel::Error) {
+				CI_LOG_E("FontManager: Error: Can't load font file at '" << path << "'; Returning default font '"
+																		 << mDefaultName << "'");
+			}
+			cache.mFontsByKey.erase(FontKey(path, size));
+			return loadFontByName(cache, mDefaultName, size);
+		}
+
+		// try creating font
+		try {
+			font = make_shared<ci::Font>(dataSource, size * mFontScale);
+
+		} catch (Exception e) {
+			if (mLogLevel >= LogLevel::Error) {
+				CI_LOG_E("FontManager: Error: Can't create font from file at '" << path << "'; Returning default font '"
+																				<< mDefaultName << "'");
+			}
+			cache.mFontsByKey.erase(FontKey(path, size));
+			return loadFontByName(cache, mDefaultName, size);
+		}
+	}
+
+	return font;
+}
+
+FontManager::FontRef FontManager::loadFontByName(Cache & cache, const std::string & name, float size) {
+	auto & font = cache.mFontsByKey[FontKey(name, size)];
+
+	if (!font) {
+		font = make_shared<ci::Font>(mDefaultName, size);
+	}
+
+	return font;
+}
+
+std::string FontManager::getFontPath(const StylesByWeight & weights, int targetWeight, FontStyle targetStyle,
 									 FallbackMode fallbackMode) {
 	if (weights.empty()) {
 		if (mLogLevel >= LogLevel::Warning) {
@@ -172,75 +315,18 @@ std::string FontManager::getFontPath(StylesByWeight & weights, int targetWeight,
 	return pathIt->second;
 }
 
-ci::Font & FontManager::getCachedFontByPath(std::string path, float size) {
-	auto & sizeMap = getCachedSizesForFont(path);
-	auto fontIt = sizeMap.find(size);
-
-	if (fontIt == sizeMap.end()) {
-		ci::DataSourceRef dataSource = nullptr;
-
-		// try loading font file
-		try {
-			dataSource = loadFile(path);
-		} catch (Exception e) {
-			if (mLogLevel >= LogLevel::Error) {
-				CI_LOG_E("FontManager: Error: Can't load font file at '" << path << "'; Returning default font '"
-																		 << mDefaultName << "'");
-			}
-			return getCachedFontByName(mDefaultName, size);
-		}
-
-		// try creating font
-		try {
-			sizeMap[size] = ci::Font(dataSource, size * mFontScale);
-
-		} catch (Exception e) {
-			if (mLogLevel >= LogLevel::Error) {
-				CI_LOG_E("FontManager: Error: Can't create font from file at '" << path << "'; Returning default font '"
-																				<< mDefaultName << "'");
-			}
-			return getCachedFontByName(mDefaultName, size);
-		}
-
-		fontIt = sizeMap.find(size);
-	}
-
-	return fontIt->second;
-}
-
-ci::Font & FontManager::getCachedFontByName(std::string name, float size) {
-	auto & sizeMap = getCachedSizesForFont(name);
-	auto fontIt = sizeMap.find(size);
-
-	if (fontIt == sizeMap.end()) {
-		sizeMap[size] = ci::Font(mDefaultName, size);
-		fontIt = sizeMap.find(size);
-	}
-
-	return fontIt->second;
-}
-
-std::map<float, ci::Font> & FontManager::getCachedSizesForFont(std::string key) {
-	auto sizeMapIt = mCachedFonts.find(key);
-	if (sizeMapIt == mCachedFonts.end()) {
-		// create new map if it doesn't exist yet
-		mCachedFonts[key] = std::map<float, ci::Font>();
-		sizeMapIt = mCachedFonts.find(key);
-	}
-	return sizeMapIt->second;
-}
-
-FontManager::StylesByWeight::iterator FontManager::getFallbackWeight(StylesByWeight & weights, int targetWeight,
-																	 FontStyle targetStyle, FallbackMode fallbackMode) {
+FontManager::StylesByWeight::const_iterator FontManager::getFallbackWeight(const StylesByWeight & weights,
+																		   int targetWeight, FontStyle targetStyle,
+																		   FallbackMode fallbackMode) {
 	int nextLowest = INT_MIN;
 	int nextHighest = INT_MAX;
-	StylesByWeight::iterator nextLowestIt = weights.end();
-	StylesByWeight::iterator nextHighestIt = weights.end();
+	StylesByWeight::const_iterator nextLowestIt = weights.end();
+	StylesByWeight::const_iterator nextHighestIt = weights.end();
 
 	// Find alternate weights with the same style
 	for (auto stylesIt = weights.begin(); stylesIt != weights.end(); ++stylesIt) {
 		int currentWeight = stylesIt->first;
-		FilePathsByStyles & paths = stylesIt->second;
+		const FilePathsByStyles & paths = stylesIt->second;
 		if (paths.count(targetStyle) == 0) continue;  // Only check if we have the right style
 
 		if (currentWeight < targetWeight && currentWeight > nextLowest) {
@@ -3,6 +3,10 @@
 #include "cinder/app/RendererGl.h"
 #include "cinder/gl/gl.h"
 
+#include <atomic>
+#include <mutex>
+#include <tuple>
+
 #include "Text.h"
 
 namespace bluecadet {
@@ -10,6 +14,9 @@ namespace text {
 
 typedef std::shared_ptr<class FontManager> FontManagerRef;
 
+// Thread-safe font cache. Lookups of fonts that have been requested before read an immutable snapshot of the cache
+// without taking a lock. Creating new fonts is serialized and publishes a new snapshot (copy-on-write).
+// Returned font references stay valid for the lifetime of the FontManager, even when other threads add fonts.
 class FontManager {
 
 public:
@@ -37,19 +44,19 @@ public:
 	// Font files should be in the json directory or in one of its child directories.
 	void setup(ci::fs::path jsonPath);
 
-	ci::Font & getFont(Style style, FallbackMode fallbackMode = Adaptive);
+	ci::Font & getFont(const Style & style, FallbackMode fallbackMode = Adaptive);
 	ci::Font & getFont(std::string family, float size, int weight = Regular, FontStyle style = Normal,
 					   FallbackMode fallbackMode = Adaptive);
 	ci::Font & getCachedFontByPath(std::string path, float size);
 	ci::Font & getCachedFontByName(std::string name, float size);
 
-	// Defaults to Arial
+	// Defaults to Arial. Should be set before fonts are requested from other threads.
 	inline const std::string & getDefaultName() const { return mDefaultName; }
-	inline void setDefaultName(const std::string value) { mDefaultName = value; }
+	void setDefaultName(const std::string value);
 
 	// Defaults to Normal
 	inline FontStyle getDefaultStyle() const { return mDefaultStyle; }
-	inline void setDefaultStyle(const FontStyle value) { mDefaultStyle = value; }
+	void setDefaultStyle(const FontStyle value);
 
 	// Defaults to Regular
 	inline int getDefaultWeight() const { return mDefaultWeight; }
@@ -69,23 +76,50 @@ protected:
 	typedef std::map<int, FilePathsByStyles> StylesByWeight;
 	typedef std::map<std::string, StylesByWeight> WeightsByFamily;
 
+	// Fonts are heap allocated so that references stay valid when the cache is copied
+	typedef std::shared_ptr<ci::Font> FontRef;
+	// Font path or name -> size
+	typedef std::pair<std::string, float> FontKey;
+	// Family, size, weight, style, fallback mode
+	typedef std::tuple<std::string, float, int, FontStyle, FallbackMode> ResolvedFontKey;
+
+	// Immutable snapshot of all cached data. Only modified before being published.
+	struct Cache {
+		WeightsByFamily mWeightsByFamily;
+		std::map<FontKey, FontRef> mFontsByKey;
+		std::map<ResolvedFontKey, FontRef> mResolvedFonts;
+	};
+	typedef std::shared_ptr<Cache> CacheRef;
+
 protected:
-	std::string getFontPath(StylesByWeight & weights, int targetWeight, FontStyle style, FallbackMode fallbackMode);
-	StylesByWeight::iterator getFallbackWeight(StylesByWeight & weights, int targetWeight, FontStyle style,
-											   FallbackMode fallbackMode);
+	std::string getFontPath(const StylesByWeight & weights, int targetWeight, FontStyle style,
+							FallbackMode fallbackMode);
+	StylesByWeight::const_iterator getFallbackWeight(const StylesByWeight & weights, int targetWeight, FontStyle style,
+													 FallbackMode fallbackMode);
+
+	// Lock-free read of the current snapshot
+	CacheRef getCache() const;
+	// Publishes a new snapshot. Must be called while mCacheMutex is locked.
+	void setCache(CacheRef cache);
+
+	// Slow paths that resolve, load and insert fonts into cache. Must be called while mCacheMutex is locked.
+	FontRef resolveFont(Cache & cache, const std::string & family, float size, int weight, FontStyle style,
+						FallbackMode fallbackMode);
+	FontRef loadFontByPath(Cache & cache, const std::string & path, float size);
+	FontRef loadFontByName(Cache & cache, const std::string & name, float size);
 
-	// Get the font sizes map for a key (either font path or font name)
-	std::map<float, ci::Font> & getCachedSizesForFont(std::string key);
+	// Removes resolved fonts after changing defaults that affect font resolution
+	void clearResolvedFonts();
 
 protected:
-	WeightsByFamily mWeightsByFamily;
-	std::map<std::string, std::map<float, ci::Font>> mCachedFonts;
+	CacheRef mCache;
+	std::mutex mCacheMutex;
 
 	std::string mDefaultName;
 	FontStyle mDefaultStyle;
 	int mDefaultWeight;
 	float mFontScale;
-	LogLevel mLogLevel;
+	std::atomic<LogLevel> mLogLevel;
 };
 
 }  // namespace text
@@ -0,0 +1,218 @@
+#include "FreeTypeTextBackend.h"
+
+#if !defined(CINDER_MSW)
+
+#include "cinder/ip/Fill.h"
+#include "cinder/ip/Premultiply.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+using namespace std;
+
+namespace bluecadet {
+namespace text {
+
+const size_t FreeTypeTextBackend::kNumFaceMutexes;
+
+FreeTypeTextBackend::FreeTypeTextBackend() {
+}
+
+FreeTypeTextBackend::~FreeTypeTextBackend() {
+}
+
+ci::vec2 FreeTypeTextBackend::measureText(const StringType & text, const ci::Font & font) {
+	FT_Face face = font.getFreetypeFace();
+	if (!face) {
+		return ci::vec2(0.0f);
+	}
+
+	lock_guard<mutex> lock(getFaceMutex(face));
+
+	const bool hasKerning = FT_HAS_KERNING(face) != 0;
+	FT_UInt prevGlyph = 0;
+	FT_Pos advance = 0;
+
+	const CharType * it = text.data();
+	const CharType * end = it + text.size();
+
+	while (it != end) {
+		const FT_UInt glyph = FT_Get_Char_Index(face, (FT_ULong)nextCodePoint(it, end));
+
+		if (hasKerning && prevGlyph && glyph) {
+			FT_Vector kerning;
+			FT_Get_Kerning(face, prevGlyph, glyph, FT_KERNING_DEFAULT, &kerning);
+			advance += kerning.x;
+		}
+
+		if (FT_Load_Glyph(face, glyph, FT_LOAD_DEFAULT) == 0) {
+			advance += face->glyph->advance.x;
+		}
+
+		prevGlyph = glyph;
+	}
+
+	// FreeType metrics are in 26.6 fixed point
+	return ci::vec2((float)advance / 64.0f, (float)face->size->metrics.height / 64.0f);
+}
+
+TextBackend::FontMetrics FreeTypeTextBackend::getFontMetrics(const ci::Font & font) {
+	FT_Face face = font.getFreetypeFace();
+	if (!face) {
+		return TextBackend::getFontMetrics(font);
+	}
+
+	lock_guard<mutex> lock(getFaceMutex(face));
+	const FT_Size_Metrics & sizeMetrics = face->size->metrics;
+
+	FontMetrics metrics;
+	metrics.mAscent = (float)sizeMetrics.ascender / 64.0f;
+	metrics.mDescent = (float)-sizeMetrics.descender / 64.0f;
+	metrics.mLeading = std::max(0.0f, (float)sizeMetrics.height / 64.0f - metrics.mAscent - metrics.mDescent);
+	return metrics;
+}
+
+void FreeTypeTextBackend::renderText(ci::Surface8u & surface, const std::vector<DrawCommand> & commands, const ci::ColorA8u & clearColor) {
+	ci::ip::fill(&surface, clearColor);
+
+	for (const auto & command : commands) {
+		// glyph slots belong to the face, so it stays locked until the command's glyphs are blended
+		lock_guard<mutex> lock(getFaceMutex(command.mFont.getFreetypeFace()));
+		forEachGlyph(command, [&](FT_GlyphSlot slot, int left, int top) {
+			blendGlyph(surface, slot->bitmap, left, top, command.mColor);
+		});
+	}
+
+	if (surface.isPremultiplied()) {
+		ci::ip::premultiply(&surface);
+	}
+}
+
+void FreeTypeTextBackend::renderCoverage(ci::Channel8u & channel, const std::vector<DrawCommand> & commands) {
+	ci::ip::fill(&channel, (uint8_t)0);
+
+	for (const auto & command : commands) {
+		lock_guard<mutex> lock(getFaceMutex(command.mFont.getFreetypeFace()));
+		forEachGlyph(command, [&](FT_GlyphSlot slot, int left, int top) {
+			blendGlyphCoverage(channel, slot->bitmap, left, top);
+		});
+	}
+}
+
+std::mutex & FreeTypeTextBackend::getFaceMutex(FT_Face face) {
+	// faces are heap allocated and aligned, so mix the address bits before picking a stripe
+	const uint64_t hash = (uint64_t)(uintptr_t)face * 0x9E3779B97F4A7C15ULL;
+	return mFaceMutexes[(size_t)(hash >> 32) % kNumFaceMutexes];
+}
+
+void FreeTypeTextBackend::forEachGlyph(const DrawCommand & command, const std::function<void(FT_GlyphSlot slot, int left, int top)> & fn) {
+	FT_Face face = command.mFont.getFreetypeFace();
+	if (!face) {
+		return;
+	}
+
+	const bool hasKerning = FT_HAS_KERNING(face) != 0;
+	const int baseline = (int)std::round(command.mOrigin.y + (float)face->size->metrics.ascender / 64.0f);
+	FT_Pos penX = (FT_Pos)std::round(command.mOrigin.x * 64.0f);
+	FT_UInt prevGlyph = 0;
+
+	const CharType * it = command.mText.data();
+	const CharType * end = it + command.mText.size();
+
+	while (it != end) {
+		const FT_UInt glyph = FT_Get_Char_Index(face, (FT_ULong)nextCodePoint(it, end));
+
+		if (hasKerning && prevGlyph && glyph) {
+			FT_Vector kerning;
+			FT_Get_Kerning(face, prevGlyph, glyph, FT_KERNING_DEFAULT, &kerning);
+			penX += kerning.x;
+		}
+
+		if (FT_Load_Glyph(face, glyph, FT_LOAD_RENDER) == 0) {
+			const FT_GlyphSlot slot = face->glyph;
+			fn(slot, (int)(penX >> 6) + slot->bitmap_left, baseline - slot->bitmap_top);
+			penX += slot->advance.x;
+		}
+
+		prevGlyph = glyph;
+	}
+}
+
+void FreeTypeTextBackend::blendGlyph(ci::Surface8u & surface, const FT_Bitmap & bitmap, int left, int top, const ci::ColorA & color) {
+	if (bitmap.pixel_mode != FT_PIXEL_MODE_GRAY) {
+		return;
+	}
+
+	const int x0 = std::max(0, left);
+	const int y0 = std::max(0, top);
+	const int x1 = std::min(surface.getWidth(), left + (int)bitmap.width);
+	const int y1 = std::min(surface.getHeight(), top + (int)bitmap.rows);
+
+	const bool hasAlpha = surface.hasAlpha();
+	const uint8_t inc = surface.getPixelInc();
+	const uint8_t r = surface.getRedOffset();
+	const uint8_t g = surface.getGreenOffset();
+	const uint8_t b = surface.getBlueOffset();
+	const uint8_t a = surface.getAlphaOffset();
+
+	for (int y = y0; y < y1; ++y) {
+		const uint8_t * src = bitmap.buffer + (y - top) * bitmap.pitch;
+		uint8_t * dst = surface.getData() + y * surface.getRowBytes();
+
+		for (int x = x0; x < x1; ++x) {
+			const uint8_t coverage = src[x - left];
+			if (coverage == 0) {
+				continue;
+			}
+
+			uint8_t * pixel = dst + x * inc;
+			const float srcAlpha = color.a * (float)coverage / 255.0f;
+			const float dstAlpha = hasAlpha ? (float)pixel[a] / 255.0f : 1.0f;
+			const float outAlpha = srcAlpha + dstAlpha * (1.0f - srcAlpha);
+
+			if (outAlpha <= 0.0f) {
+				continue;
+			}
+
+			// straight alpha "over" compositing
+			const float dstWeight = dstAlpha * (1.0f - srcAlpha);
+			pixel[r] = (uint8_t)((color.r * 255.0f * srcAlpha + (float)pixel[r] * dstWeight) / outAlpha + 0.5f);
+			pixel[g] = (uint8_t)((color.g * 255.0f * srcAlpha + (float)pixel[g] * dstWeight) / outAlpha + 0.5f);
+			pixel[b] = (uint8_t)((color.b * 255.0f * srcAlpha + (float)pixel[b] * dstWeight) / outAlpha + 0.5f);
+
+			if (hasAlpha) {
+				pixel[a] = (uint8_t)(outAlpha * 255.0f + 0.5f);
+			}
+		}
+	}
+}
+
+void FreeTypeTextBackend::blendGlyphCoverage(ci::Channel8u & channel, const FT_Bitmap & bitmap, int left, int top) {
+	if (bitmap.pixel_mode != FT_PIXEL_MODE_GRAY) {
+		return;
+	}
+
+	const int x0 = std::max(0, left);
+	const int y0 = std::max(0, top);
+	const int x1 = std::min(channel.getWidth(), left + (int)bitmap.width);
+	const int y1 = std::min(channel.getHeight(), top + (int)bitmap.rows);
+	const uint8_t inc = channel.getIncrement();
+
+	for (int y = y0; y < y1; ++y) {
+		const uint8_t * src = bitmap.buffer + (y - top) * bitmap.pitch;
+		uint8_t * dst = channel.getData() + y * channel.getRowBytes();
+
+		for (int x = x0; x < x1; ++x) {
+			// "over" compositing of coverage: dst + src * (1 - dst)
+			uint8_t & pixel = dst[x * inc];
+			const int coverage = src[x - left];
+			pixel = (uint8_t)(pixel + (coverage * (255 - pixel) + 127) / 255);
+		}
+	}
+}
+
+}
+}
+
+#endif
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "TextBackend.h"
+
+#if !defined(CINDER_MSW)
+
+#include <functional>
+#include <mutex>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+namespace bluecadet {
+namespace text {
+
+typedef std::shared_ptr<class FreeTypeTextBackend> FreeTypeTextBackendRef;
+
+//! Measures and renders text using the FreeType faces of ci::Font. Requires no window or graphics context, so it can be used headless (e.g. to pre-render text on Linux).
+class FreeTypeTextBackend : public TextBackend {
+public:
+	FreeTypeTextBackend();
+	~FreeTypeTextBackend();
+
+	ci::vec2 measureText(const StringType & text, const ci::Font & font) override;
+	FontMetrics getFontMetrics(const ci::Font & font) override;
+	void renderText(ci::Surface8u & surface, const std::vector<DrawCommand> & commands, const ci::ColorA8u & clearColor) override;
+	void renderCoverage(ci::Channel8u & channel, const std::vector<DrawCommand> & commands) override;
+
+protected:
+	//! Blends an 8-bit glyph coverage bitmap in color into the surface with its top-left corner at left/top (non-premultiplied).
+	static void blendGlyph(ci::Surface8u & surface, const FT_Bitmap & bitmap, int left, int top, const ci::ColorA & color);
+
+	//! Accumulates an 8-bit glyph coverage bitmap into the channel with its top-left corner at left/top.
+	static void blendGlyphCoverage(ci::Channel8u & channel, const FT_Bitmap & bitmap, int left, int top);
+
+	//! Loads and renders every glyph of a command and calls fn with the glyph slot and its top-left position.
+	static void forEachGlyph(const DrawCommand & command, const std::function<void(FT_GlyphSlot slot, int left, int top)> & fn);
+
+	//! Returns the lock guarding face. FreeType faces can't be used by multiple threads at once, but different faces can,
+	//! so faces are locked individually (striped across a fixed number of mutexes) instead of serializing the backend.
+	std::mutex & getFaceMutex(FT_Face face);
+
+	static const size_t kNumFaceMutexes = 64;
+	std::mutex mFaceMutexes[kNumFaceMutexes];
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,136 @@
+#include "GdiPlusTextBackend.h"
+
+#if defined(CINDER_MSW)
+
+#include "cinder/Noncopyable.h"
+
+#include <mutex>
+
+#include <Windows.h>
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#include <gdiplus.h>
+//#include <WinGdi.h> # Use this for GDI (not GDI+)
+#undef min
+#undef max
+#include "cinder/msw/CinderMsw.h"
+#include "cinder/msw/CinderMswGdiPlus.h"
+#pragma comment(lib, "gdiplus")
+
+using namespace std;
+
+namespace bluecadet {
+namespace text {
+
+//==================================================
+// DeviceContextManager Helper
+//
+
+class DeviceContextManager : private ci::Noncopyable {
+public:
+	DeviceContextManager() :
+		mDummyDC(::CreateCompatibleDC(0)),
+		mGraphics(mDummyDC),
+		mStringFormat(Gdiplus::StringFormat::GenericTypographic())
+	{
+		int flags = 0;
+		flags |= Gdiplus::StringFormatFlagsMeasureTrailingSpaces;	// Important when calculating layout of multiple runs
+		flags |= Gdiplus::StringFormatFlagsNoClip;					// Don't clip words
+		flags |= Gdiplus::StringFormatFlagsNoFitBlackBox;			// Don't try to compress and fit (only applies when passing a rect)
+		mStringFormat.SetFormatFlags(flags);
+		mStringFormat.SetAlignment(Gdiplus::StringAlignmentNear);
+		mStringFormat.SetLineAlignment(Gdiplus::StringAlignmentNear);
+	}
+	~DeviceContextManager() {
+		::DeleteDC(mDummyDC);
+	}
+	static DeviceContextManager * instance() {
+		// thread-safe static initialization
+		static DeviceContextManager* instance = new DeviceContextManager();
+		return instance;
+	}
+	const HDC &						getDc() { return mDummyDC; }
+	const Gdiplus::Graphics &		getGraphics() { return mGraphics; }
+	Gdiplus::StringFormat &			getStringFormat() { return mStringFormat; }
+	std::mutex &					getMutex() { return mMutex; }
+
+private:
+	HDC						mDummyDC;
+	Gdiplus::Graphics		mGraphics;
+	Gdiplus::StringFormat	mStringFormat;
+	std::mutex				mMutex;	// Guards the shared graphics and string format
+};
+
+//==================================================
+// GdiPlusTextBackend
+//
+
+GdiPlusTextBackend::GdiPlusTextBackend() {
+	// forces any globals we need to be initialized, particularly GDI+ on Windows
+	DeviceContextManager::instance();
+}
+
+GdiPlusTextBackend::~GdiPlusTextBackend() {
+}
+
+ci::vec2 GdiPlusTextBackend::measureText(const StringType & text, const ci::Font & font) {
+	// the shared graphics and string format are not thread-safe
+	lock_guard<mutex> lock(DeviceContextManager::instance()->getMutex());
+
+	// GDI+ only accepts wide strings, so UTF-8 text is converted here
+	const std::wstring & wideText = wideString(text);
+
+	// Important: explicitly enable kerning for character range
+	auto range = Gdiplus::CharacterRange(0, (int)wideText.length());
+	auto & format = DeviceContextManager::instance()->getStringFormat();
+	format.SetMeasurableCharacterRanges(1, &range);
+
+	Gdiplus::RectF sizeRect;
+	DeviceContextManager::instance()->getGraphics().MeasureString(wideText.c_str(), -1,
+																  font.getGdiplusFont(), Gdiplus::PointF(0, 0), &format, &sizeRect);
+
+	return ci::vec2(sizeRect.Width, sizeRect.Height);
+}
+
+ci::Surface8u GdiPlusTextBackend::createSurface(const ci::ivec2 & size, bool useAlpha) {
+	return ci::Surface8u(size.x, size.y, useAlpha, ci::SurfaceConstraintsGdiPlus());
+}
+
+bool GdiPlusTextBackend::isSurfaceCompatible(const ci::Surface8u & surface) {
+	// GDI+ bitmaps require BGR(A) pixels and 4-byte aligned rows
+	const auto code = surface.getChannelOrder().getCode();
+	const bool isBgr = code == ci::SurfaceChannelOrder::BGRA || code == ci::SurfaceChannelOrder::BGRX || code == ci::SurfaceChannelOrder::BGR;
+	return isBgr && surface.getRowBytes() % 4 == 0;
+}
+
+void GdiPlusTextBackend::renderText(ci::Surface8u & surface, const std::vector<DrawCommand> & commands, const ci::ColorA8u & clearColor) {
+	Gdiplus::Bitmap *offscreenBitmap = ci::msw::createGdiplusBitmap(surface);
+	Gdiplus::Graphics *offscreenGraphics = Gdiplus::Graphics::FromImage(offscreenBitmap);
+	offscreenGraphics->SetTextRenderingHint(Gdiplus::TextRenderingHint::TextRenderingHintAntiAlias);
+	offscreenGraphics->Clear(Gdiplus::Color(clearColor.a, clearColor.r, clearColor.g, clearColor.b));
+
+	// copy the shared format since character ranges are modified per command
+	unique_lock<mutex> formatLock(DeviceContextManager::instance()->getMutex());
+	Gdiplus::StringFormat format(&DeviceContextManager::instance()->getStringFormat());
+	formatLock.unlock();
+
+	for (const auto & command : commands) {
+		const ci::ColorA8u color = command.mColor;
+		const Gdiplus::SolidBrush brush(Gdiplus::Color(color.a, color.r, color.g, color.b));
+		const Gdiplus::PointF origin(command.mOrigin.x, command.mOrigin.y);
+		const std::wstring & wideText = wideString(command.mText);
+		const Gdiplus::CharacterRange range(0, (int)wideText.length());
+		format.SetMeasurableCharacterRanges(1, &range);
+		offscreenGraphics->DrawString(wideText.c_str(), -1, command.mFont.getGdiplusFont(), origin, &format, &brush);
+	}
+
+	GdiFlush();
+
+	delete offscreenBitmap;
+	delete offscreenGraphics;
+}
+
+}
+}
+
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "TextBackend.h"
+
+#if defined(CINDER_MSW)
+
+namespace bluecadet {
+namespace text {
+
+typedef std::shared_ptr<class GdiPlusTextBackend> GdiPlusTextBackendRef;
+
+//! Measures and renders text using GDI+. Windows only.
+//! Thread-safe: measuring shares a single GDI+ context and is serialized, rendering uses a separate context per surface.
+class GdiPlusTextBackend : public TextBackend {
+public:
+	GdiPlusTextBackend();
+	~GdiPlusTextBackend();
+
+	ci::vec2 measureText(const StringType & text, const ci::Font & font) override;
+	ci::Surface8u createSurface(const ci::ivec2 & size, bool useAlpha) override;
+	bool isSurfaceCompatible(const ci::Surface8u & surface) override;
+	void renderText(ci::Surface8u & surface, const std::vector<DrawCommand> & commands, const ci::ColorA8u & clearColor) override;
+};
+
+}
+}
+
+#endif
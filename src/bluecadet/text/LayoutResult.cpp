@@ -0,0 +1,98 @@
+#include "LayoutResult.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace bluecadet {
+namespace text {
+
+LayoutResult::LayoutResult() :
+	mTextSize(0, 0),
+	mPaddingTop(0.0f),
+	mPaddingRight(0.0f),
+	mPaddingBottom(0.0f),
+	mPaddingLeft(0.0f) {
+}
+
+LayoutResult::~LayoutResult() {
+}
+
+ci::ivec2 LayoutResult::getRenderSize() const {
+	ci::ivec2 bitmapSize = mTextSize;
+
+	if (bitmapSize.x < 0 || bitmapSize.y < 0) {
+		return bitmapSize;
+	}
+
+	// I don't have a great explanation for this other than it seems to be necessary
+	bitmapSize.y += 1;
+
+	return bitmapSize;
+}
+
+size_t LayoutResult::getLineIndexAtY(const float y) const {
+	if (mLines.empty()) {
+		return 0;
+	}
+
+	// first offset greater than y is the bottom of the line at y
+	const auto it = std::upper_bound(mLineOffsets.begin(), mLineOffsets.end(), y);
+	const size_t index = it == mLineOffsets.begin() ? 0 : (size_t)(it - mLineOffsets.begin()) - 1;
+	return std::min(index, mLines.size() - 1);
+}
+
+std::pair<size_t, size_t> LayoutResult::getLineRange(const float offsetY, const float height) const {
+	const size_t firstLine = getLineIndexAtY(offsetY);
+	const auto lastLineIt = std::lower_bound(mLineOffsets.begin(), mLineOffsets.end(), offsetY + height);
+	const size_t lastLine = std::min((size_t)(lastLineIt - mLineOffsets.begin()), mLines.size());
+	return std::make_pair(firstLine, std::max(firstLine, lastLine));
+}
+
+vector<TextBackend::DrawCommand> LayoutResult::buildDrawCommands(const float maxWidth) const {
+	return buildDrawCommands(maxWidth, 0, mLines.size(), 0.0f);
+}
+
+vector<TextBackend::DrawCommand> LayoutResult::buildDrawCommands(const float maxWidth, const size_t firstLine, const size_t lastLine, const float offsetY) const {
+	vector<TextBackend::DrawCommand> commands;
+
+	if (lastLine > firstLine && lastLine <= mLines.size()) {
+		commands.reserve(mLines[lastLine - 1].mFirstRun + mLines[lastLine - 1].mNumRuns - mLines[firstLine].mFirstRun);
+	}
+
+	for (size_t i = firstLine; i < lastLine && i < mLines.size(); ++i) {
+		const auto & line = mLines[i];
+		const float currentY = mLineOffsets[i] - offsetY + line.mLeadingOffset + line.mLeading;
+
+		float currentX = mPaddingLeft;
+
+		if (line.mTextAlign == TextAlign::Center) {
+			currentX = (maxWidth - line.mSize.x) * 0.5f;
+
+		} else if (line.mTextAlign == TextAlign::Right) {
+			currentX = maxWidth - line.mSize.x - mPaddingRight;
+		}
+
+		for (uint32_t runIndex = line.mFirstRun; runIndex < line.mFirstRun + line.mNumRuns; ++runIndex) {
+			const auto & run = mRuns[runIndex];
+			const auto & font = mFonts[run.mFontId];
+			TextBackend::DrawCommand command;
+			command.mText = getRunText(run);
+			command.mFont = font.mFont;
+			command.mColor = mColors[run.mColorId];
+			command.mOrigin = ci::vec2(currentX, currentY + (line.mAscent - font.mMetrics.mAscent));
+			command.mSize = ci::vec2(run.mAdvance, run.mHeight);
+			commands.push_back(command);
+			currentX += run.mAdvance;
+		}
+	}
+
+	return commands;
+}
+
+void LayoutResult::render(ci::Surface8u & surface, TextBackendRef backend, const ci::ColorA8u & clearColor) const {
+	backend->renderText(surface, buildDrawCommands((float)surface.getWidth()), clearColor);
+}
+
+}
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Surface.h"
+#include "cinder/Font.h"
+
+#include <utility>
+#include <vector>
+
+#include "Text.h"
+#include "TextBackend.h"
+
+namespace bluecadet {
+namespace text {
+
+typedef std::shared_ptr<const class LayoutResult> LayoutResultRef;
+
+//! Immutable snapshot of a laid out StyledTextLayout: lines, runs, metrics and size.
+//! Stored as flat arrays: a single text buffer, run records that reference text, fonts and colors by index and line
+//! records that reference a range of runs.
+//! Results are exported on demand by StyledTextLayout::getLayoutResult() (and by async renders) and never change
+//! afterwards, so they can be shared with and rendered on other threads while the layout keeps changing. The layout's
+//! own lines and runs remain the primary storage; synchronous rendering never creates a result.
+class LayoutResult {
+public:
+
+	//! A run of text with uniform font and color. Text is stored in getText() and referenced by offset and length.
+	struct RunRecord {
+		uint32_t	mTextOffset;
+		uint32_t	mTextLength;
+		uint32_t	mFontId;		//! Index into getFonts()
+		uint32_t	mColorId;		//! Index into getColors()
+		float		mAdvance;
+		float		mHeight;
+	};
+
+	//! A line of runs. Runs are referenced as a contiguous range in getRuns().
+	struct LineRecord {
+		uint32_t	mFirstRun;
+		uint32_t	mNumRuns;
+		TextAlign	mTextAlign;
+		ci::vec2	mSize;
+		float		mLeadingOffset;
+		float		mAscent;
+		float		mDescent;
+		float		mLeading;
+	};
+
+	//! A font shared by all runs with the same font id.
+	struct FontRecord {
+		ci::Font					mFont;
+		TextBackend::FontMetrics	mMetrics;
+	};
+
+	~LayoutResult();
+
+	//! The text size including padding according to the clip and wrap modes at the time of layout.
+	inline const ci::ivec2 &				getTextSize() const { return mTextSize; }
+
+	//! The size of surfaces needed to render this result.
+	ci::ivec2								getRenderSize() const;
+
+	//! Text of all runs in order.
+	inline const StringType &				getText() const { return mText; }
+	inline const std::vector<RunRecord> &	getRuns() const { return mRuns; }
+	inline const std::vector<LineRecord> &	getLines() const { return mLines; }
+	inline const std::vector<FontRecord> &	getFonts() const { return mFonts; }
+	inline const std::vector<ci::ColorA> &	getColors() const { return mColors; }
+
+	//! Copies the text of a single run.
+	inline StringType						getRunText(const RunRecord & run) const { return mText.substr(run.mTextOffset, run.mTextLength); }
+
+	//! The rendered top of each line (including padding), followed by the bottom of the last line. Contains getLines().size() + 1 values.
+	inline const std::vector<float> &		getLineOffsets() const { return mLineOffsets; }
+
+	//! Returns the index of the line at y using a binary search over the line offsets. Clamps to the first and last line.
+	size_t									getLineIndexAtY(const float y) const;
+
+	//! Returns the range [first, last) of lines that overlap the vertical range [offsetY, offsetY + height).
+	std::pair<size_t, size_t>				getLineRange(const float offsetY, const float height) const;
+
+	inline float							getPaddingTop() const { return mPaddingTop; }
+	inline float							getPaddingRight() const { return mPaddingRight; }
+	inline float							getPaddingBottom() const { return mPaddingBottom; }
+	inline float							getPaddingLeft() const { return mPaddingLeft; }
+
+	//! Positions all runs of all lines within maxWidth.
+	std::vector<TextBackend::DrawCommand>	buildDrawCommands(const float maxWidth) const;
+
+	//! Positions all runs of lines [firstLine, lastLine) within maxWidth and moves them up by offsetY.
+	std::vector<TextBackend::DrawCommand>	buildDrawCommands(const float maxWidth, const size_t firstLine, const size_t lastLine, const float offsetY) const;
+
+	//! Renders all lines into surface using backend. Can be called from any thread.
+	void									render(ci::Surface8u & surface, TextBackendRef backend, const ci::ColorA8u & clearColor = ci::ColorA8u()) const;
+
+protected:
+	friend class StyledTextLayout;
+
+	LayoutResult();
+
+	StringType					mText;
+	std::vector<RunRecord>		mRuns;
+	std::vector<LineRecord>		mLines;
+	std::vector<FontRecord>		mFonts;
+	std::vector<ci::ColorA>		mColors;
+	std::vector<float>			mLineOffsets;
+	ci::ivec2					mTextSize;
+	float						mPaddingTop;
+	float						mPaddingRight;
+	float						mPaddingBottom;
+	float						mPaddingLeft;
+};
+
+}
+}
@@ -0,0 +1,103 @@
+#include "MappedFile.h"
+
+#if defined(CINDER_MSW)
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace bluecadet {
+namespace text {
+
+MappedFile::MappedFile() :
+	mData(nullptr),
+	mSize(0)
+#if defined(CINDER_MSW)
+	, mFileHandle(INVALID_HANDLE_VALUE),
+	mMappingHandle(nullptr)
+#endif
+{
+}
+
+MappedFileRef MappedFile::create(const ci::fs::path & path) {
+	// constructor is protected, so make_shared can't be used
+	MappedFileRef file(new MappedFile());
+
+#if defined(CINDER_MSW)
+	file->mFileHandle = ::CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file->mFileHandle == INVALID_HANDLE_VALUE) {
+		return nullptr;
+	}
+
+	LARGE_INTEGER size;
+	if (!::GetFileSizeEx(file->mFileHandle, &size)) {
+		return nullptr;
+	}
+
+	file->mSize = (size_t)size.QuadPart;
+
+	// empty files can't be mapped
+	if (file->mSize == 0) {
+		return file;
+	}
+
+	file->mMappingHandle = ::CreateFileMappingW(file->mFileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!file->mMappingHandle) {
+		return nullptr;
+	}
+
+	file->mData = (const char *)::MapViewOfFile(file->mMappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (!file->mData) {
+		return nullptr;
+	}
+#else
+	const int fd = ::open(path.string().c_str(), O_RDONLY);
+	if (fd < 0) {
+		return nullptr;
+	}
+
+	struct stat info;
+	if (::fstat(fd, &info) != 0) {
+		::close(fd);
+		return nullptr;
+	}
+
+	file->mSize = (size_t)info.st_size;
+
+	if (file->mSize > 0) {
+		void * data = ::mmap(nullptr, file->mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (data == MAP_FAILED) {
+			::close(fd);
+			return nullptr;
+		}
+
+		// files are read front to back
+		::madvise(data, file->mSize, MADV_SEQUENTIAL);
+		file->mData = (const char *)data;
+	}
+
+	// the mapping stays valid after closing the file
+	::close(fd);
+#endif
+
+	return file;
+}
+
+MappedFile::~MappedFile() {
+#if defined(CINDER_MSW)
+	if (mData) ::UnmapViewOfFile(mData);
+	if (mMappingHandle) ::CloseHandle(mMappingHandle);
+	if (mFileHandle != INVALID_HANDLE_VALUE) ::CloseHandle(mFileHandle);
+#else
+	if (mData) ::munmap((void *)mData, mSize);
+#endif
+}
+
+}
+}
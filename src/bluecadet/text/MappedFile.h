@@ -0,0 +1,38 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Filesystem.h"
+#include "cinder/Noncopyable.h"
+
+namespace bluecadet {
+namespace text {
+
+typedef std::shared_ptr<class MappedFile> MappedFileRef;
+
+//! Read-only memory map of an entire file. Pages are loaded by the OS on first access, so large files can be
+//! processed without reading them into memory first.
+class MappedFile : private ci::Noncopyable {
+
+public:
+	//! Returns nullptr if the file can't be opened or mapped.
+	static MappedFileRef create(const ci::fs::path & path);
+
+	~MappedFile();
+
+	const char * getData() const { return mData; }
+	size_t getSize() const { return mSize; }
+
+protected:
+	MappedFile();
+
+	const char * mData;
+	size_t mSize;
+
+#if defined(CINDER_MSW)
+	void * mFileHandle;
+	void * mMappingHandle;
+#endif
+};
+
+}
+}
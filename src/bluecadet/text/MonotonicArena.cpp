@@ -0,0 +1,77 @@
+#include "MonotonicArena.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace bluecadet {
+namespace text {
+
+MonotonicArena & MonotonicArena::getThreadLocal() {
+	static thread_local MonotonicArena arena;
+	return arena;
+}
+
+MonotonicArena::MonotonicArena(size_t initialBlockSize) :
+	mCurrent(nullptr),
+	mEnd(nullptr),
+	mNumBytesUsed(0),
+	mInitialBlockSize(initialBlockSize),
+	mScopeDepth(0) {
+}
+
+MonotonicArena::~MonotonicArena() {
+}
+
+void * MonotonicArena::allocate(size_t numBytes, size_t alignment) {
+	uintptr_t address = ((uintptr_t)mCurrent + (alignment - 1)) & ~(uintptr_t)(alignment - 1);
+
+	if (!mCurrent || address + numBytes > (uintptr_t)mEnd) {
+		addBlock(numBytes + alignment);
+		address = ((uintptr_t)mCurrent + (alignment - 1)) & ~(uintptr_t)(alignment - 1);
+	}
+
+	mNumBytesUsed += (address + numBytes) - (uintptr_t)mCurrent;
+	mCurrent = (uint8_t *)(address + numBytes);
+	return (void *)address;
+}
+
+void MonotonicArena::reset() {
+	if (mBlocks.size() > 1) {
+		// replace all blocks with a single one that fits everything used before
+		const size_t capacity = getCapacity();
+		mBlocks.clear();
+		addBlock(capacity);
+	}
+
+	if (!mBlocks.empty()) {
+		mCurrent = mBlocks.back().mData.get();
+		mEnd = mCurrent + mBlocks.back().mSize;
+	}
+
+	mNumBytesUsed = 0;
+}
+
+size_t MonotonicArena::getCapacity() const {
+	size_t capacity = 0;
+	for (const auto & block : mBlocks) {
+		capacity += block.mSize;
+	}
+	return capacity;
+}
+
+void MonotonicArena::addBlock(size_t minSize) {
+	// grow geometrically to keep the number of blocks per pass small
+	const size_t size = std::max(minSize, std::max(mInitialBlockSize, getCapacity()));
+
+	Block block;
+	block.mData.reset(new uint8_t[size]);
+	block.mSize = size;
+
+	mCurrent = block.mData.get();
+	mEnd = mCurrent + size;
+	mBlocks.push_back(std::move(block));
+}
+
+}
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace bluecadet {
+namespace text {
+
+//! Bump allocator for short-lived data during layout passes. Memory is only released in bulk via reset().
+//! After a reset, the arena keeps a single block large enough for the previous pass, so repeated passes of similar
+//! size don't allocate at all. Not thread-safe; use getThreadLocal() to get an arena for the current thread.
+class MonotonicArena {
+public:
+
+	//! Arena of the calling thread.
+	static MonotonicArena & getThreadLocal();
+
+	//! Resets the arena when the outermost scope on this arena is destroyed. Scopes can be nested, e.g. when a layout
+	//! pass triggers another pass.
+	class Scope {
+	public:
+		Scope(MonotonicArena & arena) : mArena(arena) { ++mArena.mScopeDepth; }
+		~Scope() { if (--mArena.mScopeDepth == 0) mArena.reset(); }
+		Scope(const Scope &) = delete;
+		Scope & operator=(const Scope &) = delete;
+	protected:
+		MonotonicArena & mArena;
+	};
+
+	MonotonicArena(size_t initialBlockSize = 16 * 1024);
+	~MonotonicArena();
+
+	MonotonicArena(const MonotonicArena &) = delete;
+	MonotonicArena & operator=(const MonotonicArena &) = delete;
+
+	//! Returns uninitialized memory of at least numBytes aligned to alignment (a power of two).
+	void * allocate(size_t numBytes, size_t alignment = alignof(std::max_align_t));
+
+	//! Releases all allocations at once. Coalesces all blocks into one block of the combined size.
+	void reset();
+
+	//! Number of bytes handed out since the last reset.
+	inline size_t getNumBytesUsed() const { return mNumBytesUsed; }
+
+	//! Combined size of all blocks owned by the arena.
+	size_t getCapacity() const;
+
+protected:
+	struct Block {
+		std::unique_ptr<uint8_t[]>	mData;
+		size_t						mSize;
+	};
+
+	void addBlock(size_t minSize);
+
+	std::vector<Block> mBlocks;
+	uint8_t * mCurrent;
+	uint8_t * mEnd;
+	size_t mNumBytesUsed;
+	size_t mInitialBlockSize;
+	int mScopeDepth;
+};
+
+//! STL allocator that allocates from a MonotonicArena. Deallocation is a no-op.
+template <typename T>
+class ArenaAllocator {
+public:
+	typedef T value_type;
+
+	ArenaAllocator(MonotonicArena & arena) : mArena(&arena) {}
+	template <typename U> ArenaAllocator(const ArenaAllocator<U> & other) : mArena(other.getArena()) {}
+
+	T * allocate(size_t n) { return static_cast<T *>(mArena->allocate(n * sizeof(T), alignof(T))); }
+	void deallocate(T *, size_t) {}
+
+	inline MonotonicArena * getArena() const { return mArena; }
+
+	template <typename U> bool operator==(const ArenaAllocator<U> & other) const { return mArena == other.getArena(); }
+	template <typename U> bool operator!=(const ArenaAllocator<U> & other) const { return mArena != other.getArena(); }
+
+protected:
+	MonotonicArena * mArena;
+};
+
+//! Containers backed by a MonotonicArena
+template <typename T> using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+template <typename K, typename V, typename Compare = std::less<K>> using ArenaMap = std::map<K, V, Compare, ArenaAllocator<std::pair<const K, V>>>;
+
+}
+}
@@ -0,0 +1,70 @@
+#include "StyleClassTable.h"
+
+#include <type_traits>
+
+#include "StyleTable.h"
+
+using namespace std;
+
+namespace bluecadet {
+namespace text {
+
+StyleClassTable::StyleClassTable(const std::map<std::string, Style> & styles) :
+	mMask(0),
+	mNumStyles(styles.size()) {
+
+	// keep the load factor at or below 50% so probe sequences stay short
+	size_t numSlots = 1;
+	while (numSlots < styles.size() * 2) numSlots <<= 1;
+
+	mSlots.resize(numSlots);
+	mMask = numSlots - 1;
+
+	StyleTable & styleTable = *StyleTable::get();
+
+	for (const auto & style : styles) {
+		Slot slot;
+		slot.mName = toStringType(style.first);
+		slot.mHash = getHash(slot.mName);
+		slot.mStyleId = styleTable.intern(style.second);
+		slot.mIsUsed = true;
+
+		size_t index = slot.mHash & mMask;
+		while (mSlots[index].mIsUsed) index = (index + 1) & mMask;
+		mSlots[index] = std::move(slot);
+	}
+}
+
+StyleClassTable::~StyleClassTable() {
+}
+
+bool StyleClassTable::find(const StringViewType & name, StyleId & id) const {
+	if (mNumStyles == 0) {
+		return false;
+	}
+
+	const size_t hash = getHash(name);
+
+	for (size_t index = hash & mMask; mSlots[index].mIsUsed; index = (index + 1) & mMask) {
+		const Slot & slot = mSlots[index];
+		if (slot.mHash == hash && StringViewType(slot.mName) == name) {
+			id = slot.mStyleId;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+size_t StyleClassTable::getHash(const StringViewType & name) {
+	// FNV-1a over code units
+	uint64_t hash = 14695981039346656037ULL;
+	for (const CharType c : name) {
+		hash ^= (uint64_t)(std::make_unsigned<CharType>::type)c;
+		hash *= 1099511628211ULL;
+	}
+	return (size_t)hash;
+}
+
+}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "Text.h"
+
+namespace bluecadet {
+namespace text {
+
+typedef std::shared_ptr<const class StyleClassTable> StyleClassTableRef;
+
+//! Immutable hash table from style names to interned StyleIds. Built once when StyleManager loads styles so that
+//! `<span class="...">` tags can be resolved straight from the parsed text without building strings or copying styles.
+//! Uses open addressing with linear probing, so lookups hash the name in place and never allocate.
+class StyleClassTable {
+
+public:
+	//! Interns all styles and indexes them by name
+	StyleClassTable(const std::map<std::string, Style> & styles);
+	~StyleClassTable();
+
+	//! Finds the id of the style with the exact (case-sensitive) name. Returns false if there's no such style.
+	bool find(const text::StringViewType & name, StyleId & id) const;
+
+	size_t getNumStyles() const { return mNumStyles; }
+
+protected:
+	struct Slot {
+		size_t mHash;
+		text::StringType mName;
+		StyleId mStyleId;
+		bool mIsUsed;
+		Slot() : mHash(0), mStyleId(0), mIsUsed(false) {}
+	};
+
+	static size_t getHash(const text::StringViewType & name);
+
+	std::vector<Slot> mSlots;
+	size_t mMask;
+	size_t mNumStyles;
+};
+
+}
+}
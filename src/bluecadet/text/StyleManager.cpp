@@ -7,13 +7,15 @@ using namespace std;
 namespace bluecadet {
 namespace text {
 
-StyleManager::StyleManager() {
+StyleManager::StyleManager() :
+	mStyleClassTable(make_shared<StyleClassTable>(std::map<std::string, Style>())) {
 }
 
 StyleManager::~StyleManager() {
 }
 
 Style StyleManager::getStyle(const std::string& key) {
+	shared_lock<shared_timed_mutex> lock(mMutex);
 	auto styleIt = mStyles.find(key);
 	if (styleIt == mStyles.end()) {
 		console() << "StyleManager: Warning: Could not find style with key '" << key << "'" << endl;
@@ -22,12 +24,26 @@ Style StyleManager::getStyle(const std::string& key) {
 	return styleIt->second;
 }
 
+StyleClassTableRef StyleManager::getStyleClassTable() const {
+	return atomic_load(&mStyleClassTable);
+}
+
+Style StyleManager::getDefaultStyle() const {
+	shared_lock<shared_timed_mutex> lock(mMutex);
+	return mDefaultStyle;
+}
+
+void StyleManager::setDefaultStyle(const Style value) {
+	unique_lock<shared_timed_mutex> lock(mMutex);
+	mDefaultStyle = value;
+}
+
 void StyleManager::setup(ci::fs::path jsonPath, const std::string basePath) {
-	parseStyles(jsonPath, mDefaultStyle, basePath);
+	parseStyles(jsonPath, getDefaultStyle(), basePath);
 }
 
 void StyleManager::parseStyles(ci::fs::path jsonPath, const std::string basePath) {
-	parseStyles(jsonPath, mDefaultStyle, basePath);
+	parseStyles(jsonPath, getDefaultStyle(), basePath);
 }
 
 void StyleManager::parseStyles(ci::fs::path jsonPath, const Style& baseStyle, const std::string basePath) {
@@ -54,10 +70,15 @@ void StyleManager::parseStyles(ci::fs::path jsonPath, const Style& baseStyle, co
 }
 
 void StyleManager::parseStyles(const ci::JsonTree& node, const std::string basePath) {
-	parseStyles(node, mDefaultStyle, basePath);
+	parseStyles(node, getDefaultStyle(), basePath);
 }
 
 void StyleManager::parseStyles(const ci::JsonTree& node, const Style& baseStyle, const std::string basePath) {
+	parseStyleNode(node, baseStyle, basePath);
+	updateStyleClassTable();
+}
+
+void StyleManager::parseStyleNode(const ci::JsonTree& node, const Style& baseStyle, const std::string basePath) {
 	try {
 
 		if (node.getNodeType() != JsonTree::NodeType::NODE_OBJECT) {
@@ -82,17 +103,18 @@ void StyleManager::parseStyles(const ci::JsonTree& node, const Style& baseStyle,
 
 		if (isRoot) {
 			// re-define default style from root style
-			mDefaultStyle = style;
+			setDefaultStyle(style);
 
 		} else if(!path.empty()) {
 			// save style to style map
 			const string& styleKey = getStrippedPath(path, basePath + ".");
+			unique_lock<shared_timed_mutex> lock(mMutex);
 			mStyles[styleKey] = style;
 		}
 
 		// parse child styles while inheriting from the current style
 		for (auto& child : node.getChildren()) {
-			parseStyles(child, style);
+			parseStyleNode(child, style);
 		}
 
 	}
@@ -102,6 +124,12 @@ void StyleManager::parseStyles(const ci::JsonTree& node, const Style& baseStyle,
 
 }
 
+void StyleManager::updateStyleClassTable() {
+	// build and publish while holding the lock so that concurrent parses can't publish an outdated table
+	unique_lock<shared_timed_mutex> lock(mMutex);
+	atomic_store(&mStyleClassTable, StyleClassTableRef(make_shared<StyleClassTable>(mStyles)));
+}
+
 std::string StyleManager::getStrippedPath(const std::string& path, const std::string& basePath) {
 	const size_t pathLength = path.length();
 	const size_t basePathLength = basePath.length();
@@ -4,13 +4,17 @@
 #include "cinder/gl/gl.h"
 #include "cinder/Json.h"
 
+#include <shared_mutex>
+
 #include "Text.h"
+#include "StyleClassTable.h"
 
 namespace bluecadet {
 namespace text {
 
 typedef std::shared_ptr<class StyleManager> StyleManagerRef;
 
+//! Thread-safe: styles can be read from multiple threads concurrently, while parsing styles takes an exclusive lock.
 class StyleManager {
 
 public:
@@ -45,13 +49,22 @@ public:
 	//! Returns a copy of an existing style or a default style if no style with that name is found. 
 	Style getStyle(const std::string& name);
 
-	Style getDefaultStyle() const { return mDefaultStyle; }
-	void setDefaultStyle(const Style value) { mDefaultStyle = value; }
+	//! Immutable lookup table from style names to interned StyleIds. Rebuilt whenever styles are parsed, so it's
+	//! cheap to resolve styles by name at parse time (e.g. for `<span class="myStyle">` tags).
+	StyleClassTableRef getStyleClassTable() const;
+
+	Style getDefaultStyle() const;
+	void setDefaultStyle(const Style value);
 
 protected:
+	void parseStyleNode(const ci::JsonTree& node, const Style& baseStyle, const std::string basePath = "styles");
+	void updateStyleClassTable();
+
 	std::string getStrippedPath(const std::string& path, const std::string& basePath);
 	std::map<std::string, Style> mStyles;
+	StyleClassTableRef mStyleClassTable;	//! Replaced atomically after styles are parsed
 	Style mDefaultStyle;
+	mutable std::shared_timed_mutex mMutex;
 };
 
 }
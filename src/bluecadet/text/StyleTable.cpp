@@ -0,0 +1,130 @@
+#include "StyleTable.h"
+
+using namespace std;
+
+namespace bluecadet {
+namespace text {
+
+const StyleId StyleTable::kDefaultId;
+const StyleId StyleTable::kInvalidId;
+
+//==================================================
+// StyledText
+//
+
+StyledText::StyledText(const Style & style, const StringType & wtext) :
+	mStyleId(StyleTable::get()->intern(style)),
+	mWText(wtext),
+	mHasColor(false) {
+}
+
+const Style & StyledText::getStyle() const {
+	return StyleTable::get()->getStyle(mStyleId);
+}
+
+//==================================================
+// StyleTable
+//
+
+StyleTable::StyleTable() :
+	mNumStyles(0),
+	mHasLoggedOverflow(false) {
+	intern(Style());
+}
+
+StyleTable::~StyleTable() {
+}
+
+StyleId StyleTable::intern(const Style & style, const StyleId fallbackId) {
+	{
+		shared_lock<shared_timed_mutex> lock(mMutex);
+		const auto it = mIds.find(style);
+		if (it != mIds.end()) {
+			return it->second;
+		}
+	}
+
+	unique_lock<shared_timed_mutex> lock(mMutex);
+
+	// another thread might have interned the same style in the meantime
+	const auto it = mIds.find(style);
+	if (it != mIds.end()) {
+		return it->second;
+	}
+
+	const size_t numStyles = mNumStyles;
+	const size_t chunkIndex = numStyles >> kChunkSizeBits;
+
+	if (chunkIndex >= kMaxNumChunks) {
+		if (!mHasLoggedOverflow) {
+			CI_LOG_E("StyleTable: Error: Can't intern more than " << (kMaxNumChunks << kChunkSizeBits) << " styles. New styles fall back to the closest existing style.");
+			mHasLoggedOverflow = true;
+		}
+		return fallbackId;
+	}
+
+	if (!mChunks[chunkIndex]) {
+		mChunks[chunkIndex].reset(new Entry[(size_t)1 << kChunkSizeBits]);
+	}
+
+	const StyleId id = (StyleId)numStyles;
+	mChunks[chunkIndex][id & kChunkIndexMask].mStyle = style;
+	mIds[style] = id;
+	mNumStyles = numStyles + 1;
+
+	if (mNumStyles == kWarningNumStyles) {
+		CI_LOG_W("Interned " << kWarningNumStyles << " distinct styles. Styles are never released, so avoid animating layout properties such as font sizes.");
+	}
+
+	return id;
+}
+
+StyleId StyleTable::getBoldId(const StyleId id) {
+	return getVariantId(id, &Entry::mBoldId, [](Style & style) { style.fontWeight(FontWeight::Bold); });
+}
+
+StyleId StyleTable::getItalicId(const StyleId id) {
+	return getVariantId(id, &Entry::mItalicId, [](Style & style) { style.fontStyle(FontStyle::Italic); });
+}
+
+StyleId StyleTable::getUprightId(const StyleId id) {
+	return getVariantId(id, &Entry::mUprightId, [](Style & style) { style.fontStyle(FontStyle::Normal); });
+}
+
+StyleId StyleTable::getVariantId(const StyleId id, std::atomic<StyleId> Entry::*variantId, const std::function<void(Style & style)> & fn) {
+	Entry & entry = mChunks[id >> kChunkSizeBits][id & kChunkIndexMask];
+	StyleId result = (entry.*variantId).load(memory_order_acquire);
+
+	if (result == kInvalidId) {
+		Style variant(entry.mStyle);
+		fn(variant);
+		result = intern(variant, id);
+		(entry.*variantId).store(result, memory_order_release);
+	}
+
+	return result;
+}
+
+size_t StyleTable::StyleHash::operator()(const Style & style) const {
+	// See boost::hash_combine
+	size_t seed = 0;
+	const auto combine = [&seed](const size_t value) {
+		seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+	};
+
+	combine(std::hash<std::string>()(style.mFontFamily));
+	combine(std::hash<int>()(style.mFontWeight));
+	combine(std::hash<int>()((int)style.mFontStyle));
+	combine(std::hash<float>()(style.mFontSize));
+	combine(std::hash<float>()(style.mColor.r));
+	combine(std::hash<float>()(style.mColor.g));
+	combine(std::hash<float>()(style.mColor.b));
+	combine(std::hash<float>()(style.mColor.a));
+	combine(std::hash<int>()((int)style.mTextAlign));
+	combine(std::hash<int>()((int)style.mTextTransform));
+	combine(std::hash<float>()(style.mLeadingOffset));
+	return seed;
+}
+
+}
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "Text.h"
+
+namespace bluecadet {
+namespace text {
+
+typedef std::shared_ptr<class StyleTable> StyleTableRef;
+
+//! Interns styles so that identical styles share one StyleId. StyledText and the parser's style stack refer to styles
+//! by id, which makes copying and comparing them cheap. Derived bold/italic/upright variants are memoized per style.
+//! Styles are never removed, so the table grows with the number of distinct styles used by the application. Paint-only
+//! color changes of existing text are kept on StyledText instead, so animating colors doesn't grow the table.
+//! Thread-safe: looking up styles by id doesn't lock, interning new styles takes an exclusive lock.
+class StyleTable {
+
+public:
+
+	static StyleTableRef get() {
+		static auto instance = std::make_shared<StyleTable>();
+		return instance;
+	}
+
+	StyleTable();
+	~StyleTable();
+
+	//! Returns the id of an identical style if it's been interned before or interns a copy of the style.
+	//! If the table is full, logs an error once and returns fallbackId instead. Callers pass the closest style they
+	//! already have (e.g. the segment's current style or the enclosing style while parsing), so text keeps rendering
+	//! with a related style rather than crashing.
+	StyleId intern(const Style & style, const StyleId fallbackId = kDefaultId);
+
+	//! Returns the style for an id returned by intern(). Styles are immutable and references remain valid.
+	inline const Style & getStyle(const StyleId id) const {
+		return mChunks[id >> kChunkSizeBits][id & kChunkIndexMask].mStyle;
+	}
+
+	//! Bold variant of a style
+	StyleId getBoldId(const StyleId id);
+	//! Italic variant of a style
+	StyleId getItalicId(const StyleId id);
+	//! Non-italic variant of a style
+	StyleId getUprightId(const StyleId id);
+
+	//! Number of interned styles
+	size_t getNumStyles() const { return mNumStyles; }
+
+	//! Id of the default Style(), which is always interned
+	static const StyleId kDefaultId = 0;
+
+protected:
+	static const StyleId kInvalidId = ~(StyleId)0;
+	static const size_t kChunkSizeBits = 10;
+	static const size_t kChunkIndexMask = (1 << kChunkSizeBits) - 1;
+	static const size_t kMaxNumChunks = 4096;
+	static const size_t kWarningNumStyles = 1 << 16;
+
+	struct Entry {
+		Style mStyle;
+		std::atomic<StyleId> mBoldId;
+		std::atomic<StyleId> mItalicId;
+		std::atomic<StyleId> mUprightId;
+		Entry() : mBoldId(kInvalidId), mItalicId(kInvalidId), mUprightId(kInvalidId) {}
+	};
+
+	struct StyleHash {
+		size_t operator()(const Style & style) const;
+	};
+
+	StyleId getVariantId(const StyleId id, std::atomic<StyleId> Entry::*variantId, const std::function<void(Style & style)> & fn);
+
+	// Entries are stored in fixed-size chunks that are never moved, so reading an existing entry is lock-free
+	std::unique_ptr<Entry[]> mChunks[kMaxNumChunks];
+	std::unordered_map<Style, StyleId, StyleHash> mIds;
+	std::atomic<size_t> mNumStyles;
+	bool mHasLoggedOverflow;	//! Guarded by mMutex
+	mutable std::shared_timed_mutex mMutex;
+};
+
+}
+}
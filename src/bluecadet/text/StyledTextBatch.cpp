@@ -0,0 +1,53 @@
+#include "StyledTextBatch.h"
+
+#include "StyleManager.h"
+
+using namespace std;
+
+namespace bluecadet {
+namespace text {
+
+std::vector<StyledTextBatch::Result> StyledTextBatch::run(const std::vector<Job> & jobs, WorkerPoolRef pool) {
+	if (!pool) {
+		pool = WorkerPool::get();
+	}
+
+	// each job writes only to its own slot
+	vector<Result> results(jobs.size());
+
+	pool->parallelFor(jobs.size(), [&](size_t i) {
+		results[i] = run(jobs[i]);
+	});
+
+	return results;
+}
+
+StyledTextBatch::Result StyledTextBatch::run(const Job & job) {
+	const Style style = job.mStyleName.empty() ? job.mStyle : StyleManager::get()->getStyle(job.mStyleName);
+
+	Result result;
+	result.mLayout = StyledTextLayout::create(style);
+
+	// configure before adding text to avoid relayouts
+	result.mLayout->setLayoutMode(job.mLayoutMode);
+	result.mLayout->setClipMode(job.mClipMode);
+	result.mLayout->setMaxSize(job.mMaxSize);
+
+	if (job.mParseTags) {
+		result.mLayout->setText(job.mText, style);
+	} else {
+		result.mLayout->setPlainText(job.mText, style);
+	}
+
+	if (job.mRender) {
+		result.mSurface = result.mLayout->renderToSurface(job.mUseAlpha, job.mPremultiplied);
+	} else {
+		// validate layout and size on this thread
+		result.mLayout->getTextSize();
+	}
+
+	return result;
+}
+
+}
+}
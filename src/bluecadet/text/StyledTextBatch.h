@@ -0,0 +1,50 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Surface.h"
+
+#include <string>
+#include <vector>
+
+#include "Text.h"
+#include "StyledTextLayout.h"
+#include "WorkerPool.h"
+
+namespace bluecadet {
+namespace text {
+
+//! Lays out and optionally renders many independent texts in parallel, e.g. all labels of a scene at load time.
+//! Parsing, style lookups, font creation and measuring are shared across threads via the thread-safe StyledTextParser,
+//! StyleManager, FontManager and TextBackend singletons.
+class StyledTextBatch {
+public:
+
+	//! A single text to lay out.
+	struct Job {
+		std::string mText;
+		std::string mStyleName;								//! If not empty, the style is loaded from the StyleManager and mStyle is ignored
+		Style mStyle;
+		ci::vec2 mMaxSize = ci::vec2(-1.0f, -1.0f);
+		StyledTextLayout::LayoutMode mLayoutMode = StyledTextLayout::WordWrap;
+		StyledTextLayout::ClipMode mClipMode = StyledTextLayout::Clip;
+		bool mParseTags = true;								//! Parses style tags if true, otherwise text is set as plain text
+		bool mRender = false;								//! Renders the laid out text into mSurface of the result
+		bool mUseAlpha = true;
+		bool mPremultiplied = false;
+	};
+
+	//! Layout and optional surface of a single job.
+	struct Result {
+		StyledTextLayoutRef mLayout;
+		ci::Surface8u mSurface;
+	};
+
+	//! Processes all jobs on pool (or WorkerPool::get() if nullptr) and blocks until all are done. Results are returned in the same order as jobs.
+	static std::vector<Result> run(const std::vector<Job> & jobs, WorkerPoolRef pool = nullptr);
+
+	//! Processes a single job on the calling thread.
+	static Result run(const Job & job);
+};
+
+}
+}
@@ -35,90 +35,35 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "cinder/Font.h"
 #include "cinder/Vector.h"
 
-#if !defined(CINDER_MSW)
-
-#warning "StyledTextLayout: Warning: This class is only supported on Windows 7+"
-
-#else
-
-#include <Windows.h>
-#define max(a, b) (((a) > (b)) ? (a) : (b))
-#define min(a, b) (((a) < (b)) ? (a) : (b))
-#include <gdiplus.h>
-//#include <WinGdi.h> # Use this for GDI (not GDI+)
-#undef min
-#undef max
-#include "cinder/msw/CinderMsw.h"
-#include "cinder/msw/CinderMswGdiPlus.h"
-#pragma comment(lib, "gdiplus")
-#include "cinder/Unicode.h"
-
 #include <limits.h>
-#include <locale>
-#include <codecvt>
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <tuple>
 #include <string>
 
 #include "FontManager.h"
 #include "StyleManager.h"
+#include "StyleTable.h"
+#include "SurfacePool.h"
 #include "StyledTextParser.h"
+#include "MonotonicArena.h"
 
 using namespace std;
 
 namespace bluecadet {
 namespace text {
 
-
-typedef std::wstring StringType;
-typedef wchar_t CharType;
-
-//==================================================
-// DeviceContextManager Helper
-//
-
-class DeviceContextManager : private ci::Noncopyable {
-public:
-	DeviceContextManager() :
-		mDummyDC(::CreateCompatibleDC(0)),
-		mGraphics(mDummyDC),
-		mStringFormat(Gdiplus::StringFormat::GenericTypographic())
-	{
-		int flags = 0;
-		flags |= Gdiplus::StringFormatFlagsMeasureTrailingSpaces;	// Important when calculating layout of multiple runs
-		flags |= Gdiplus::StringFormatFlagsNoClip;					// Don't clip words
-		flags |= Gdiplus::StringFormatFlagsNoFitBlackBox;			// Don't try to compress and fit (only applies when passing a rect)
-		mStringFormat.SetFormatFlags(flags);
-		mStringFormat.SetAlignment(Gdiplus::StringAlignmentNear);
-		mStringFormat.SetLineAlignment(Gdiplus::StringAlignmentNear);
-	}
-	~DeviceContextManager() {
-		::DeleteDC(mDummyDC);
-	}
-	static DeviceContextManager * instance() {
-		static DeviceContextManager* instance = nullptr;
-		if (!instance) instance = new DeviceContextManager();
-		return instance;
-	}
-	const HDC &						getDc() { return mDummyDC; }
-	const Gdiplus::Graphics &		getGraphics() { return mGraphics; }
-	Gdiplus::StringFormat &			getStringFormat() { return mStringFormat; }
-
-
-private:
-	HDC						mDummyDC;
-	Gdiplus::Graphics		mGraphics;
-	Gdiplus::StringFormat	mStringFormat;
-};
-
-
 //==================================================
 // Run Helper
 //
 
-StyledTextLayout::Run::Run(Style style, const ci::Font & aFont, const ci::ColorA & aColor) :
-	mStyle(style),
+StyledTextLayout::Run::Run(const ci::Font & aFont, const ci::ColorA & aColor, TextBackendRef backend) :
+	mHasInvalidExtents(true),
 	mFont(aFont),
 	mColor(aColor),
-	mHasInvalidExtents(true) {
+	mBackend(backend),
+	mMetrics(backend->getFontMetrics(aFont)) {
 }
 StyledTextLayout::Run::~Run() {};
 
@@ -127,28 +72,37 @@ void StyledTextLayout::Run::append(const StringType & text) {
 	mHasInvalidExtents = true;
 }
 
+void StyledTextLayout::Run::append(const CharType * text, const size_t length) {
+	mWideText.append(text, length);
+	mHasInvalidExtents = true;
+}
+
+void StyledTextLayout::Run::truncate(const size_t length) {
+	if (length < mWideText.length()) {
+		mWideText.resize(length);
+		mHasInvalidExtents = true;
+	}
+}
+
 void StyledTextLayout::Run::setText(const StringType & text) {
 	mWideText = text;
 	mHasInvalidExtents = true;
 }
 
+void StyledTextLayout::Run::modifyPaintStyle(const std::function<void(Style & style)> & fn) {
+	// runs only retain paint properties
+	Style style;
+	style.mColor = mColor;
+	fn(style);
+	mColor = style.mColor;
+}
+
 void StyledTextLayout::Run::calcExtents() {
 	if (!mHasInvalidExtents) {
 		return;
 	}
 
-	// Important: explicitly enable kerning for character range
-	auto range = Gdiplus::CharacterRange(0, (int)mWideText.length());
-	//mFormat.SetMeasurableCharacterRanges(1, &range);
-	auto & format = DeviceContextManager::instance()->getStringFormat();
-	format.SetMeasurableCharacterRanges(1, &range);
-
-	Gdiplus::RectF sizeRect;
-	DeviceContextManager::instance()->getGraphics().MeasureString(mWideText.c_str(), -1,
-																  mFont.getGdiplusFont(), Gdiplus::PointF(0, 0), &format, &sizeRect);
-	
-	mSize.x = sizeRect.Width;
-	mSize.y = sizeRect.Height;
+	mSize = mBackend->measureText(mWideText, mFont);
 	mHasInvalidExtents = false;
 }
 
@@ -158,9 +112,10 @@ void StyledTextLayout::Run::calcExtents() {
 
 StyledTextLayout::Line::Line(TextAlign aTextAlign, float aLeadingOffset, bool aLeadingDisabled) :
 	mTextAlign(aTextAlign),
+	mSize(0, 0),
 	mLeadingOffset(aLeadingOffset),
 	mLeadingDisabled(aLeadingDisabled),
-	mSize(0, 0), mAscent(0), mDescent(0), mLeading(0),
+	mDescent(0), mLeading(0), mAscent(0),
 	mHasInvalidExtents(false) {
 }
 StyledTextLayout::Line::~Line() {}
@@ -179,14 +134,14 @@ void StyledTextLayout::Line::calcExtents() {
 
 	for (auto run : mRuns) {
 		mSize.x += run->getSize().x;
-		mAscent = std::max(run->getFont().getAscent(), mAscent);
-		mDescent = std::max(run->getFont().getDescent(), mDescent);
+		mAscent = std::max(run->getAscent(), mAscent);
+		mDescent = std::max(run->getDescent(), mDescent);
 
 		if (mLeadingDisabled) {
 			//mLeading = 1.0f; // seems necessary to correctly measure layout when using a typographic format
 			mLeading = 0.0f;
 		} else {
-			mLeading = std::max(run->getFont().getLeading(), mLeading);
+			mLeading = std::max(run->getLeading(), mLeading);
 		}
 
 		mSize.y = std::max(mSize.y, run->getSize().y);
@@ -201,26 +156,37 @@ void StyledTextLayout::Line::calcExtents() {
 //
 
 StyledTextLayout::StyledTextLayout() :
+	mHasInvalidLayout(false),
+	mHasInvalidLineBreaks(false),
+	mHasInvalidSize(false),
+	mHasInvalidRender(false),
+	mHasInvalidLayoutResult(true),
+	mHasTruncatedLines(false),
+	mCompletedLinesHeight(0.0f),
+	mTextSize(0, 0),
+	mNumEvictedSegments(0),
+	mMaxNumLines(0),
+	mLayoutMode(WordWrap),
+	mClipMode(Clip),
+	mSizeTrimmingEnabled(false),
+	mLeadingDisabled(true),
+	mParallelParagraphsEnabled(false),
+	mMaxSize(-1.0f, -1.0f),
 	mPaddingTop(0.0f),
 	mPaddingRight(0.0f),
 	mPaddingBottom(0.0f),
 	mPaddingLeft(0.0f),
-	mLayoutMode(WordWrap),
-	mClipMode(Clip),
-	mMaxSize(-1.0f, -1.0f),
-	mLeadingDisabled(true),
-	mHasInvalidSize(false),
-	mHasInvalidLayout(false),
-	mSizeTrimmingEnabled(false),
-	mTextSize(0, 0) {
-	// forces any globals we need to be initialized, particularly GDI+ on Windows
-	DeviceContextManager::instance();
-
+	mBackend(TextBackend::getDefault()),
+	mAsyncRenderState(make_shared<AsyncRenderState>()),
+	mNumAsyncRenders(0) {
 	mCurrentStyle = StyleManager::get()->getDefaultStyle();
 	mParseOptions = StyledTextParser::get()->getDefaultOptions();
 }
 
 StyledTextLayout::~StyledTextLayout() {
+	for (const auto & render : mPendingAsyncRenders) {
+		render.wait();
+	}
 }
 
 StyledTextLayoutRef StyledTextLayout::create(Style style) {
@@ -235,26 +201,65 @@ StyledTextLayoutRef StyledTextLayout::create(Style style) {
 
 void StyledTextLayout::clearText() {
 	mSegments.clear();
-	mLines.clear();
+	mMeasuredSegments.clear();
+	mNumEvictedSegments = 0;
+	clearLines();
 	invalidate();
 }
 
 
+// std::string overloads expect UTF-8. Converted to wide text unless BLUECADET_TEXT_USE_UTF8 is defined.
+void StyledTextLayout::setText(const string & text, const TokenParserMapRef customTokenParsers) { clearText(); appendText(text, customTokenParsers); }
+void StyledTextLayout::setText(const string & text, const string styleName, const TokenParserMapRef customTokenParsers) { clearText(); appendText(text, styleName, true, customTokenParsers); }
+void StyledTextLayout::setText(const string & text, const Style& style, const TokenParserMapRef customTokenParsers) { clearText(); appendText(text, style, true, customTokenParsers); }
+
+void StyledTextLayout::appendText(const string & text, const TokenParserMapRef customTokenParsers) {
+	appendParsedText(toStringType(text), mCurrentStyle, customTokenParsers);
+}
+void StyledTextLayout::appendText(const string & text, const string & styleName, bool saveAsCurrentStyle, const TokenParserMapRef customTokenParsers) {
+	Style style = StyleManager::get()->getStyle(styleName);
+	if (saveAsCurrentStyle) setCurrentStyle(style);
+	appendParsedText(toStringType(text), style, customTokenParsers);
+}
+void StyledTextLayout::appendText(const string & text, const Style& style, bool saveAsCurrentStyle, const TokenParserMapRef customTokenParsers) {
+	if (saveAsCurrentStyle) setCurrentStyle(style);
+	appendParsedText(toStringType(text), style, customTokenParsers);
+}
+
+void StyledTextLayout::setPlainText(const string & text) { clearText(); appendPlainText(text); }
+void StyledTextLayout::setPlainText(const string & text, const string styleName) { clearText(); appendPlainText(text, styleName); }
+void StyledTextLayout::setPlainText(const string & text, const Style& style) { clearText(); appendPlainText(text, style); }
+
+void StyledTextLayout::appendPlainText(const string & text) {
+	appendSegment(StyledText(mCurrentStyle, toStringType(text)));
+}
+void StyledTextLayout::appendPlainText(const string & text, const string & styleName, bool saveAsCurrentStyle) {
+	Style style = StyleManager::get()->getStyle(styleName);
+	if (saveAsCurrentStyle) setCurrentStyle(style);
+	appendSegment(StyledText(style, toStringType(text)));
+}
+void StyledTextLayout::appendPlainText(const string & text, const Style& style, bool saveAsCurrentStyle) {
+	if (saveAsCurrentStyle) setCurrentStyle(style);
+	appendSegment(StyledText(style, toStringType(text)));
+}
+
+
+// std::wstring overloads. Converted to UTF-8 if BLUECADET_TEXT_USE_UTF8 is defined.
 void StyledTextLayout::setText(const wstring & text, const TokenParserMapRef customTokenParsers) { clearText(); appendText(text, customTokenParsers); }
 void StyledTextLayout::setText(const wstring & text, const string styleName, const TokenParserMapRef customTokenParsers) { clearText(); appendText(text, styleName, true, customTokenParsers); }
 void StyledTextLayout::setText(const wstring & text, const Style& style, const TokenParserMapRef customTokenParsers) { clearText(); appendText(text, style, true, customTokenParsers); }
 
 void StyledTextLayout::appendText(const wstring & text, const TokenParserMapRef customTokenParsers) {
-	appendSegments(StyledTextParser::get()->parse(text, mCurrentStyle, mParseOptions, customTokenParsers));
+	appendParsedText(toStringType(text), mCurrentStyle, customTokenParsers);
 }
 void StyledTextLayout::appendText(const wstring & text, const string & styleName, bool saveAsCurrentStyle, const TokenParserMapRef customTokenParsers) {
 	Style style = StyleManager::get()->getStyle(styleName);
 	if (saveAsCurrentStyle) setCurrentStyle(style);
-	appendSegments(StyledTextParser::get()->parse(text, style, mParseOptions, customTokenParsers));
+	appendParsedText(toStringType(text), style, customTokenParsers);
 }
 void StyledTextLayout::appendText(const wstring & text, const Style& style, bool saveAsCurrentStyle, const TokenParserMapRef customTokenParsers) {
 	if (saveAsCurrentStyle) setCurrentStyle(style);
-	appendSegments(StyledTextParser::get()->parse(text, style, mParseOptions, customTokenParsers));
+	appendParsedText(toStringType(text), style, customTokenParsers);
 }
 
 void StyledTextLayout::setPlainText(const wstring & text) { clearText(); appendPlainText(text); }
@@ -262,35 +267,76 @@ void StyledTextLayout::setPlainText(const wstring & text, const string styleName
 void StyledTextLayout::setPlainText(const wstring & text, const Style& style) { clearText(); appendPlainText(text, style); }
 
 void StyledTextLayout::appendPlainText(const wstring & text) {
-	appendSegment(StyledText(mCurrentStyle, text));
+	appendSegment(StyledText(mCurrentStyle, toStringType(text)));
 }
 void StyledTextLayout::appendPlainText(const wstring & text, const string & styleName, bool saveAsCurrentStyle) {
 	Style style = StyleManager::get()->getStyle(styleName);
 	if (saveAsCurrentStyle) setCurrentStyle(style);
-	appendSegment(StyledText(style, text));
+	appendSegment(StyledText(style, toStringType(text)));
 }
 void StyledTextLayout::appendPlainText(const wstring & text, const Style& style, bool saveAsCurrentStyle) {
 	if (saveAsCurrentStyle) setCurrentStyle(style);
-	appendSegment(StyledText(style, text));
+	appendSegment(StyledText(style, toStringType(text)));
 }
 
+bool StyledTextLayout::setTextFile(const ci::fs::path & path, const TokenParserMapRef customTokenParsers) { clearText(); return appendTextFile(path, customTokenParsers); }
+
+bool StyledTextLayout::appendTextFile(const ci::fs::path & path, const TokenParserMapRef customTokenParsers) {
+	return StyledTextParser::get()->parseFile(path, mCurrentStyle, mParseOptions, customTokenParsers, [this](const std::vector<StyledText> & segments) {
+		appendSegments(segments);
+	});
+}
+
+
+void StyledTextLayout::appendParsedText(const StringType & text, const Style & style, const TokenParserMapRef customTokenParsers) {
+	auto parser = StyledTextParser::get();
+	auto pool = mWorkerPool ? mWorkerPool : WorkerPool::get();
+
+	// splitting only adds overhead if paragraphs can't run concurrently
+	if (!mParallelParagraphsEnabled || pool->getNumThreads() == 0) {
+		appendSegments(*parser->parseShared(StringViewType(text), style, mParseOptions, customTokenParsers));
+		return;
+	}
+
+	const auto paragraphs = parser->splitParagraphs(StringViewType(text), mParseOptions, customTokenParsers);
+
+	if (paragraphs.size() <= 1) {
+		appendSegments(*parser->parseShared(StringViewType(text), style, mParseOptions, customTokenParsers));
+		return;
+	}
+
+	// The first paragraph might continue the current last line, so it's only broken into lines in parallel if there are no lines yet.
+	// All other paragraphs start after a break.
+	const bool canBreakLines = canBreakParagraphsInParallel();
+	const bool canBreakFirstParagraph = canBreakLines && mLines.empty();
 
-// std::string helpers to convert to widestring
-void StyledTextLayout::setText(const string & text, const TokenParserMapRef customTokenParsers) { setText(wideString(text), customTokenParsers); }
-void StyledTextLayout::setText(const string & text, const string styleName, const TokenParserMapRef customTokenParsers) { setText(wideString(text), styleName, customTokenParsers); }
-void StyledTextLayout::setText(const string & text, const Style& style, const TokenParserMapRef customTokenParsers) { setText(wideString(text), style, customTokenParsers); }
+	vector<vector<StyledText>> segments(paragraphs.size());
+	vector<shared_ptr<StyledTextLayout>> paragraphLayouts(paragraphs.size());
 
-void StyledTextLayout::appendText(const string & text, const TokenParserMapRef customTokenParsers) { appendText(wideString(text), customTokenParsers); }
-void StyledTextLayout::appendText(const string & text, const string & styleName, bool saveAsCurrentStyle, const TokenParserMapRef customTokenParsers) { appendText(wideString(text), styleName, saveAsCurrentStyle, customTokenParsers); }
-void StyledTextLayout::appendText(const string & text, const Style& style, bool saveAsCurrentStyle, const TokenParserMapRef customTokenParsers) { appendText(wideString(text), style, saveAsCurrentStyle, customTokenParsers); }
+	// each paragraph writes only to its own slot
+	pool->parallelFor(paragraphs.size(), [&](size_t i) {
+		segments[i] = parser->parseParagraph(paragraphs, i, style, mParseOptions, customTokenParsers);
 
-void StyledTextLayout::setPlainText(const string & text) { setPlainText(wideString(text)); }
-void StyledTextLayout::setPlainText(const string & text, const string styleName) { setPlainText(wideString(text), styleName); }
-void StyledTextLayout::setPlainText(const string & text, const Style& style) { setPlainText(wideString(text), style); }
+		if (canBreakLines && (i > 0 || canBreakFirstParagraph)) {
+			paragraphLayouts[i] = createParagraphLayout();
+			paragraphLayouts[i]->appendSegments(segments[i]);
+		}
+	});
+
+	const auto baseStyle = mCurrentStyle;
+
+	for (size_t i = 0; i < paragraphs.size(); ++i) {
+		if (paragraphLayouts[i]) {
+			appendParagraphLayout(*paragraphLayouts[i]);
+		} else {
+			for (const auto & segment : segments[i]) {
+				appendSegment(segment);
+			}
+		}
+	}
 
-void StyledTextLayout::appendPlainText(const string & text) { appendPlainText(wideString(text)); }
-void StyledTextLayout::appendPlainText(const string & text, const string & styleName, bool saveAsCurrentStyle) { appendPlainText(wideString(text), styleName, saveAsCurrentStyle); }
-void StyledTextLayout::appendPlainText(const string & text, const Style& style, bool saveAsCurrentStyle) { appendPlainText(wideString(text), style, saveAsCurrentStyle); }
+	setCurrentStyle(baseStyle); // re-apply base style
+}
 
 
 //==================================================
@@ -298,10 +344,10 @@ void StyledTextLayout::appendPlainText(const string & text, const Style& style,
 //
 
 StyledTextLayout::LayoutMode StyledTextLayout::getLayoutMode() const { return mLayoutMode; }
-void StyledTextLayout::setLayoutMode(const LayoutMode value) { mLayoutMode = value; invalidate(); }
+void StyledTextLayout::setLayoutMode(const LayoutMode value) { mLayoutMode = value; invalidateLineBreaks(); }
 
 StyledTextLayout::ClipMode StyledTextLayout::getClipMode() const { return mClipMode; }
-void StyledTextLayout::setClipMode(const ClipMode value) { mClipMode = value; invalidate(); }
+void StyledTextLayout::setClipMode(const ClipMode value) { mClipMode = value; invalidateClipHeight(); }
 
 void StyledTextLayout::setCurrentStyle(Style style) { mCurrentStyle = style; }
 void StyledTextLayout::setCurrentStyle(const std::string & styleName) { mCurrentStyle = StyleManager::get()->getStyle(styleName); }
@@ -312,8 +358,8 @@ void StyledTextLayout::setFontSize(const float fontSize, bool updateExistingText
 void StyledTextLayout::setFontStyle(const FontStyle fontStyle, bool updateExistingText) { modifyStyles(updateExistingText, [&](Style& s) { s.mFontStyle = fontStyle; }); }
 void StyledTextLayout::setFontWeight(const FontWeight fontWeight, bool updateExistingText) { modifyStyles(updateExistingText, [&](Style& s) { s.mFontWeight = fontWeight; }); }
 
-void StyledTextLayout::setTextColor(const ci::Color & color, bool updateExistingText) { modifyStyles(updateExistingText, [&](Style& s) { s.mColor = color; }); }
-void StyledTextLayout::setTextColor(const ci::ColorA & color, bool updateExistingText) { modifyStyles(updateExistingText, [&](Style& s) { s.mColor = color; }); }
+void StyledTextLayout::setTextColor(const ci::Color & color, bool updateExistingText) { modifyStyles(updateExistingText, [&](Style& s) { s.mColor = color; }, StyleChange::Paint); }
+void StyledTextLayout::setTextColor(const ci::ColorA & color, bool updateExistingText) { modifyStyles(updateExistingText, [&](Style& s) { s.mColor = color; }, StyleChange::Paint); }
 
 void StyledTextLayout::setTextAlign(const TextAlign value, bool updateExistingText) { modifyStyles(updateExistingText, [&](Style& s) { s.mTextAlign = value; }); invalidate(); }
 
@@ -322,24 +368,24 @@ void StyledTextLayout::setTextTransform(const TextTransform value, bool updateEx
 void StyledTextLayout::setLeadingOffset(float leadingOffset, bool updateExistingText) { modifyStyles(updateExistingText, [&](Style& s) { s.mLeadingOffset = leadingOffset; }); invalidate(); }
 
 bool StyledTextLayout::getLeadingDisabled() const { return mLeadingDisabled; }
-void StyledTextLayout::setLeadingDisabled(const bool value, bool updateExistingText) { mLeadingDisabled = value; invalidate(); }
+void StyledTextLayout::setLeadingDisabled(const bool value, bool /*updateExistingText*/) { mLeadingDisabled = value; invalidateLineBreaks(); }
 
 const ci::vec2 & StyledTextLayout::getMaxSize() const { return mMaxSize; }
-void StyledTextLayout::setMaxSize(const ci::vec2 & value) { mMaxSize = value; invalidate(); }
+void StyledTextLayout::setMaxSize(const ci::vec2 & value) { mMaxSize = value; invalidateLineBreaks(); }
 
 float StyledTextLayout::getMaxWidth() const { return mMaxSize.x; }
-void StyledTextLayout::setMaxWidth(const float value) { mMaxSize.x = value; invalidate(); }
+void StyledTextLayout::setMaxWidth(const float value) { mMaxSize.x = value; invalidateLineBreaks(); }
 
 float StyledTextLayout::getMaxHeight() const { return mMaxSize.y; }
-void StyledTextLayout::setMaxHeight(const float value) { mMaxSize.y = value; invalidate(); }
-
-void StyledTextLayout::setPadding(const float vertical, const float horizontal) { mPaddingTop = mPaddingBottom = vertical; mPaddingRight = mPaddingLeft = horizontal; invalidate(); }
-void StyledTextLayout::setPadding(const float padding) { mPaddingTop = mPaddingRight = mPaddingBottom = mPaddingLeft = padding; invalidate(); }
-void StyledTextLayout::setPadding(const float top, const float right, const float bottom, const float left) { mPaddingTop = top; mPaddingRight = right;  mPaddingBottom = bottom; mPaddingLeft = left; invalidate(); };
-void StyledTextLayout::setPaddingTop(const float padding) { mPaddingTop = padding; invalidate(); };
-void StyledTextLayout::setPaddingRight(const float padding) { mPaddingRight = padding; invalidate(); };
-void StyledTextLayout::setPaddingBottom(const float padding) { mPaddingBottom = padding; invalidate(); };
-void StyledTextLayout::setPaddingLeft(const float padding) { mPaddingLeft = padding; invalidate(); };
+void StyledTextLayout::setMaxHeight(const float value) { mMaxSize.y = value; invalidateClipHeight(); }
+
+void StyledTextLayout::setPadding(const float vertical, const float horizontal) { mPaddingTop = mPaddingBottom = vertical; mPaddingRight = mPaddingLeft = horizontal; invalidateLineBreaks(); }
+void StyledTextLayout::setPadding(const float padding) { mPaddingTop = mPaddingRight = mPaddingBottom = mPaddingLeft = padding; invalidateLineBreaks(); }
+void StyledTextLayout::setPadding(const float top, const float right, const float bottom, const float left) { mPaddingTop = top; mPaddingRight = right;  mPaddingBottom = bottom; mPaddingLeft = left; invalidateLineBreaks(); };
+void StyledTextLayout::setPaddingTop(const float padding) { mPaddingTop = padding; invalidateClipHeight(); };
+void StyledTextLayout::setPaddingRight(const float padding) { mPaddingRight = padding; invalidateLineBreaks(); };
+void StyledTextLayout::setPaddingBottom(const float padding) { mPaddingBottom = padding; invalidateClipHeight(); };
+void StyledTextLayout::setPaddingLeft(const float padding) { mPaddingLeft = padding; invalidateLineBreaks(); };
 float StyledTextLayout::getPaddingTop() const { return mPaddingTop; };
 float StyledTextLayout::getPaddingRight() const { return mPaddingRight; };
 float StyledTextLayout::getPaddingBottom() const { return mPaddingBottom; };
@@ -349,6 +395,8 @@ int StyledTextLayout::getTextWidth() { validateSize(); return mTextSize.x; }
 int StyledTextLayout::getTextHeight() { validateSize(); return mTextSize.y; }
 ci::ivec2 StyledTextLayout::getTextSize() { validateSize(); return mTextSize; }
 
+void StyledTextLayout::setBackend(TextBackendRef backend) { mBackend = backend ? backend : TextBackend::getDefault(); invalidate(); }
+
 bool StyledTextLayout::getSizeTrimmingEnabled() const { return mSizeTrimmingEnabled; }
 void StyledTextLayout::setSizeTrimmingEnabled(const bool value) { mSizeTrimmingEnabled = value; invalidate(false, true); }
 
@@ -356,7 +404,7 @@ void StyledTextLayout::setSizeTrimmingEnabled(const bool value) { mSizeTrimmingE
 //==================================================
 // Layout
 //
-const std::vector<StyledText>& StyledTextLayout::getSegments() const { return mSegments; }
+const StyledTextLayout::SegmentList & StyledTextLayout::getSegments() const { return mSegments; }
 
 void StyledTextLayout::setSegment(const StyledText & segment) { clearText(); appendSegment(segment); }
 void StyledTextLayout::setSegments(const std::vector<StyledText> & segments) { clearText(); appendSegments(segments); }
@@ -369,7 +417,6 @@ void StyledTextLayout::appendSegments(const std::vector<StyledText> & segments)
 	setCurrentStyle(baseStyle); // re-apply base style
 }
 void StyledTextLayout::appendSegment(const StyledText & segment) {
-	//setCurrentStyle(segment.mStyle);
 	mSegments.push_back(segment);
 
 	// Only calculate layout for segment if our current layout is valid;
@@ -378,29 +425,81 @@ void StyledTextLayout::appendSegment(const StyledText & segment) {
 		return;
 	}
 
-	if (mLines.empty()) {
-		addLine(segment.mStyle);
+	// Skip segments below the clip height. They'll be measured once lines are no longer truncated.
+	if (mHasTruncatedLines) {
+		return;
 	}
 
-	shared_ptr<Line> line = mLines.back();
+	mMeasuredSegments.push_back(measureSegment(segment));
 
-	if (line->getTextAlign() != segment.mStyle.mTextAlign) {
-		// add new line if we have a new text textAlign
-		line = addLine(segment.mStyle);
+	// Line breaks for all segments will be recalculated in validateLayout()
+	if (!mHasInvalidLineBreaks) {
+		breakSegment(segment, mMeasuredSegments.back(), mSegments.size() - 1);
+		evictSegments();
+	}
+
+	invalidate(false, true); // mark size as invalid
+	mHasInvalidLayout = false; // mark layout as valid
+}
+
+StyledTextLayout::MeasuredSegment StyledTextLayout::measureSegment(const StyledText & segment) {
+	MonotonicArena & arena = MonotonicArena::getThreadLocal();
+	MonotonicArena::Scope arenaScope(arena);
+
+	const Style & style = segment.getStyle();
+
+	MeasuredSegment measured;
+	measured.mFont = FontManager::get()->getFont(style);
+	measured.mText = text::transform(segment.mWText, style.mTextTransform);
+
+	const auto advances = mBackend->getAdvanceCache().getFontAdvances(measured.mFont);
+
+	// token views are transient, so they're collected in the arena and only copied once the count is known
+	ArenaVector<TokenView> tokens{ArenaAllocator<TokenView>(arena)};
+	text::tokenizeWords(StringViewType(measured.mText), tokens);
+
+	measured.mTokens.reserve(tokens.size());
+
+	for (const auto& token : tokens) {
+		MeasuredSegment::Token measuredToken;
+		measuredToken.mOffset = (uint32_t)(token.mText.data() - measured.mText.data());
+		measuredToken.mLength = (uint32_t)token.mText.size();
+		measuredToken.mAdvance = advances->getAdvance(token.mText.data(), token.mText.size());
+		measuredToken.mIsNewline = token.mType == TokenType::Newline;
+		measuredToken.mIsWhitespace = token.mType != TokenType::Word;
+		measured.mTokens.push_back(measuredToken);
 	}
 
-	const ci::Font& font = FontManager::get()->getFont(segment.mStyle);
-	const ci::ColorA& color = segment.mStyle.mColor;
+	return measured;
+}
 
+void StyledTextLayout::breakSegment(const StyledText & segment, const MeasuredSegment & measured, const size_t segmentIndex) {
+	if (mHasTruncatedLines) {
+		return;
+	}
+
+	const Style & style = segment.getStyle();
 
-	auto run = make_shared<Run>(segment.mStyle, font, color);
+	if (mLines.empty()) {
+		addLine(style, segmentIndex);
+	}
 
-	int lastNonWordIndex = -1;
-	int lastWordIndex = 0;
+	shared_ptr<Line> line = mLines.back();
+
+	if (line->getTextAlign() != style.mTextAlign) {
+		if (hasReachedClipHeight()) {
+			mHasTruncatedLines = true;
+			return;
+		}
+
+		// add new line if we have a new text textAlign
+		line = addLine(style, segmentIndex);
+	}
 
-	static const CharType cNewline = L'\n';
-	static const CharType cWhitespace = L' ';
-	static const CharType cTab = L'\t';
+	const ci::Font& font = measured.mFont;
+	const ci::ColorA& color = segment.getColor();
+
+	auto run = make_shared<Run>(font, color, mBackend);
 
 	const float maxWidth = mMaxSize.x - mPaddingLeft - mPaddingRight;
 	bool shouldAutoWrap = mLayoutMode == LayoutMode::WordWrap;
@@ -412,112 +511,453 @@ void StyledTextLayout::appendSegment(const StyledText & segment) {
 		isWrapDisabled = false;
 	}
 
-	//const auto untransformedText = segment.mWText.empty() ? text::wideString(segment.mText) : segment.mWText;
-	const StringType untransformedText = segment.mWText;
-	const StringType wideText = text::transform(untransformedText, segment.mStyle.mTextTransform);
-	const StringType delimiters = text::wideString(" \n\t");
-	const auto tokens = text::tokenize(wideText, delimiters);
+	// Track widths as sums of cached token advances. Runs are only measured in full (including kerning) once they're
+	// added to a line, which avoids re-measuring the entire run for every token.
+	float lineAdvance = line->getSize().x;
+	float runAdvance = 0.0f;
 
-	for (const auto& token : tokens) {
-		if (token.empty()) continue;
+	// lines that only contain empty runs (e.g. after a break in a previous segment) don't have any words yet
+	bool lineHasText = std::any_of(line->getRuns().begin(), line->getRuns().end(), [](const RunRef & lineRun) {
+		return !lineRun->getText().empty();
+	});
 
-		const CharType c = token.at(0);
-		const bool isNewline = c == cNewline;
-		const bool isWhitespace = text::isSpace(c);
+	for (const auto& token : measured.mTokens) {
+		const bool isNewline = token.mIsNewline;
+		const bool isWhitespace = token.mIsWhitespace;
 
 		// strip line breaks
 		if (shouldStripBreaks && isNewline) {
 			continue;
 		}
 
-		// create temp run with new word but w/o cWhitespace for measurement
-		const StringType prevRunText = run->getText();
+		// remember where the new word starts so that it can be removed again without copying the run's text
 		const size_t prevRunTextLength = run->getText().length();
+		const CharType * tokenText = measured.mText.data() + token.mOffset;
 
 		// append text (but skip if it's a newline char when wrapping is disabled)
+		float tokenAdvance = 0.0f;
 		if (!isNewline || !isWrapDisabled) {
-			run->append(token);
+			run->append(tokenText, token.mLength);
+			tokenAdvance = token.mAdvance;
 		}
 
-		const float lineWidth = line->getSize().x + run->getSize().x;
+		const float lineWidth = lineAdvance + runAdvance + tokenAdvance;
 
 		// check if line is too wide, but only if the current word is not the only word on the line
-		const bool isFirstWordOnLine = line->getRuns().empty() && prevRunTextLength == 0;
+		const bool isFirstWordOnLine = !lineHasText && prevRunTextLength == 0;
 		const bool hasReachedMaxWidth = shouldAutoWrap && maxWidth > 0 && (lineWidth > maxWidth);
 		const bool shouldBreak = hasReachedMaxWidth && !isFirstWordOnLine;
 
 		if ((shouldBreak || isNewline) && !isWrapDisabled) {
 			// save run without new word to current line
-			run->setText(prevRunText);
+			run->truncate(prevRunTextLength);
 			line->addRun(run);
 
+			// stop once lines won't be visible anymore
+			if (hasReachedClipHeight()) {
+				mHasTruncatedLines = true;
+				return;
+			}
+
 			// start new line and run
-			line = addLine(segment.mStyle);
-			run = make_shared<Run>(segment.mStyle, font, color);
+			line = addLine(style, segmentIndex);
+			run = make_shared<Run>(font, color, mBackend);
+			lineAdvance = 0.0f;
+			runAdvance = 0.0f;
+			lineHasText = false;
 
 			if (!isWhitespace && !isNewline) {
 				// move word to next line
-				run->append(token);
+				run->append(tokenText, token.mLength);
+				runAdvance = tokenAdvance;
 			}
+		} else {
+			runAdvance += tokenAdvance;
 		}
 	}
 
 	line->addRun(run);
+}
+
+bool StyledTextLayout::canBreakParagraphsInParallel() const {
+	const bool isClipped = mClipMode == Clip && mMaxSize.y >= 0.0f;
+	const bool breaksAtNewlines = mLayoutMode == WordWrap || mLayoutMode == NoWrap;
+	const bool hasValidLines = (!mHasInvalidLineBreaks || mSegments.empty()) && !mHasTruncatedLines && (!mHasInvalidLayout || mSegments.empty()) && mMeasuredSegments.size() == mSegments.size();
+	return !isClipped && breaksAtNewlines && hasValidLines;
+}
+
+shared_ptr<StyledTextLayout> StyledTextLayout::createParagraphLayout() const {
+	auto layout = make_shared<StyledTextLayout>();
+	layout->mBackend = mBackend;
+	layout->mLayoutMode = mLayoutMode;
+	layout->mClipMode = NoClip;
+	layout->mMaxSize = ci::vec2(mMaxSize.x, -1.0f);
+	layout->mPaddingLeft = mPaddingLeft;
+	layout->mPaddingRight = mPaddingRight;
+	layout->mLeadingDisabled = mLeadingDisabled;
+	return layout;
+}
+
+void StyledTextLayout::appendParagraphLayout(StyledTextLayout & paragraph) {
+	// lines might have been invalidated by a previous paragraph
+	if (!canBreakParagraphsInParallel() || paragraph.mLines.empty()) {
+		for (const auto & segment : paragraph.mSegments) {
+			appendSegment(segment);
+		}
+		return;
+	}
+
+	if (mSegments.empty()) {
+		// there's nothing to re-break yet, so pending line break changes (e.g. a new max width) apply to the new lines
+		mHasInvalidLineBreaks = false;
+		clearLines();
+	}
+
+	const size_t firstSegmentIndex = mNumEvictedSegments + mSegments.size();
+
+	std::move(paragraph.mSegments.begin(), paragraph.mSegments.end(), std::back_inserter(mSegments));
+	std::move(paragraph.mMeasuredSegments.begin(), paragraph.mMeasuredSegments.end(), std::back_inserter(mMeasuredSegments));
+
+	auto line = paragraph.mLines.begin();
+	auto segmentIndex = paragraph.mLineSegmentIndices.begin();
+
+	// continue on the last line unless the text alignment changes (see breakSegment())
+	if (!mLines.empty() && mLines.back()->getTextAlign() == (*line)->getTextAlign()) {
+		for (const auto & run : (*line)->getRuns()) {
+			mLines.back()->addRun(run);
+		}
+		++line;
+		++segmentIndex;
+	}
 
+	for (; line != paragraph.mLines.end(); ++line, ++segmentIndex) {
+		if (!mLines.empty()) {
+			// previous line is complete
+			const auto & prevLine = mLines.back();
+			mCompletedLinesHeight += prevLine->getHeight();
+		}
+
+		mLines.push_back(*line);
+		mLineSegmentIndices.push_back(firstSegmentIndex + *segmentIndex);
+	}
+
+	evictLines();
+	evictSegments();
 	invalidate(false, true); // mark size as invalid
 	mHasInvalidLayout = false; // mark layout as valid
 }
 
-shared_ptr<StyledTextLayout::Line> StyledTextLayout::addLine(const Style & style) {
+shared_ptr<StyledTextLayout::Line> StyledTextLayout::addLine(const Style & style, const size_t segmentIndex) {
 	invalidate(false, true);
+
+	if (!mLines.empty()) {
+		// previous line is complete
+		const auto & prevLine = mLines.back();
+		mCompletedLinesHeight += prevLine->getHeight();
+	}
+
 	auto line = make_shared<Line>(style.mTextAlign, style.mLeadingOffset, mLeadingDisabled);
 	mLines.push_back(line);
+	mLineSegmentIndices.push_back(mNumEvictedSegments + segmentIndex);
+	evictLines();
 	return line;
 }
 
+void StyledTextLayout::evictLines() {
+	if (mMaxNumLines == 0) {
+		return;
+	}
+
+	while (mLines.size() > mMaxNumLines) {
+		// all lines but the last one are complete
+		const auto & line = mLines.front();
+		mCompletedLinesHeight -= line->getHeight();
+		mLines.pop_front();
+		mLineSegmentIndices.pop_front();
+	}
+}
+
+void StyledTextLayout::evictSegments() {
+	if (mMaxNumLines == 0 || mLineSegmentIndices.empty()) {
+		return;
+	}
+
+	// segments before the first remaining line won't be laid out again
+	while (mNumEvictedSegments < mLineSegmentIndices.front() && !mSegments.empty()) {
+		mSegments.pop_front();
+		if (!mMeasuredSegments.empty()) {
+			mMeasuredSegments.pop_front();
+		}
+		++mNumEvictedSegments;
+	}
+}
+
+void StyledTextLayout::setMaxNumLines(const size_t value) {
+	mMaxNumLines = value;
+	if (!mHasInvalidLayout && !mHasInvalidLineBreaks) {
+		evictLines();
+		evictSegments();
+	}
+	invalidate(false, true);
+}
+
 
 //==================================================
 // Rendering
 //
 
 bool StyledTextLayout::hasChanges() const {
-	return mHasInvalidLayout || mHasInvalidSize;
+	return mHasInvalidLayout || mHasInvalidLineBreaks || mHasInvalidSize || mHasInvalidRender;
 }
 
 ci::Surface	StyledTextLayout::renderToSurface(bool useAlpha, bool premultiplied, const ci::ColorA8u & clearColor) {
-	validateLayout();
-	validateSize();
-
 	ci::Surface result;
-	ci::ivec2 bitmapSize = ci::vec2(getTextSize());
+	const ci::ivec2 bitmapSize = getRenderSize();
 
 	// Odd failure - return a NULL Surface
 	if (bitmapSize.x < 0 || bitmapSize.y < 0) {
 		return result;
 	}
 
+	result = mSurfacePool ? mSurfacePool->acquire(bitmapSize, useAlpha, mBackend) : mBackend->createSurface(bitmapSize, useAlpha);
+	result.setPremultiplied(premultiplied);
+
+	renderInto(result, clearColor);
+
+	return result;
+}
+
+bool StyledTextLayout::renderToSurface(ci::Surface8u & surface, bool useAlpha, bool premultiplied, const ci::ColorA8u & clearColor) {
+	const ci::ivec2 bitmapSize = getRenderSize();
+
+	// Odd failure - keep the existing surface
+	if (bitmapSize.x < 0 || bitmapSize.y < 0) {
+		return false;
+	}
+
+	bool didAllocate = false;
+
+	if (!surface.getData() || surface.getSize() != bitmapSize || surface.hasAlpha() != useAlpha || !mBackend->isSurfaceCompatible(surface)) {
+		reallocateSurface(surface, bitmapSize, useAlpha);
+		didAllocate = true;
+	}
+
+	surface.setPremultiplied(premultiplied);
+	renderInto(surface, clearColor);
+
+	return didAllocate;
+}
+
+bool StyledTextLayout::renderToSurface(uint8_t * data, int32_t rowBytes, const ci::SurfaceChannelOrder & channelOrder, bool premultiplied, const ci::ColorA8u & clearColor) {
+	const ci::ivec2 bitmapSize = getRenderSize();
+
+	if (!data || bitmapSize.x < 0 || bitmapSize.y < 0) {
+		return false;
+	}
+
+	// wraps the caller's memory without taking ownership
+	ci::Surface8u surface(data, bitmapSize.x, bitmapSize.y, rowBytes, channelOrder);
+
+	if (!mBackend->isSurfaceCompatible(surface)) {
+		CI_LOG_E("StyledTextLayout: Error: Pixel format is not supported by the current text backend");
+		return false;
+	}
+
+	surface.setPremultiplied(premultiplied);
+	renderInto(surface, clearColor);
+
+	return true;
+}
+
+ci::ivec2 StyledTextLayout::getRenderSize() {
+	ci::ivec2 bitmapSize = getTextSize();
+
+	if (bitmapSize.x < 0 || bitmapSize.y < 0) {
+		return bitmapSize;
+	}
+
 	// I don't have a great explanation for this other than it seems to be necessary
 	bitmapSize.y += 1;
 
-	// Prep our GDI and GDI+ resources
-	result = ci::Surface8u(bitmapSize.x, bitmapSize.y, useAlpha, ci::SurfaceConstraintsGdiPlus());
-	result.setPremultiplied(premultiplied);
+	return bitmapSize;
+}
 
-	Gdiplus::Bitmap *offscreenBitmap = ci::msw::createGdiplusBitmap(result);
-	Gdiplus::Graphics *offscreenGraphics = Gdiplus::Graphics::FromImage(offscreenBitmap);
-	offscreenGraphics->SetTextRenderingHint(Gdiplus::TextRenderingHint::TextRenderingHintAntiAlias);
-	offscreenGraphics->Clear(Gdiplus::Color(clearColor.a, clearColor.r, clearColor.g, clearColor.b));
+void StyledTextLayout::setSurfacePool(SurfacePoolRef pool) {
+	mSurfacePool = pool;
+	mPooledSurface = ci::Surface8u();
+}
 
-	// Walk the lines and getSurface them, advancing our Y offset along the way
-	const float maxWidth = (float)bitmapSize.x;
-	const float paddingLeft = mPaddingLeft;
-	const float paddingRight =  mPaddingRight;
-	float currentY = mPaddingTop;
+void StyledTextLayout::reallocateSurface(ci::Surface8u & surface, const ci::ivec2 & size, bool useAlpha) {
+	if (!mSurfacePool) {
+		surface = mBackend->createSurface(size, useAlpha);
+		mPooledSurface = ci::Surface8u();
+		return;
+	}
 
-	for (const auto & line : mLines) {
-		currentY += line->getLeadingOffset() + line->getLeading();
+	// never pool surfaces that were passed in by the caller, only the one this layout acquired
+	if (mPooledSurface.getData() && surface.getData() == mPooledSurface.getData()) {
+		mSurfacePool->release(surface);
+	}
+
+	surface = mSurfacePool->acquire(size, useAlpha, mBackend);
+	mPooledSurface = surface;
+}
 
-		float currentX = paddingLeft;
+ci::Channel8u StyledTextLayout::renderToChannel(std::vector<RunColor> * runColors) {
+	ci::Channel8u result;
+	renderToChannel(result, runColors);
+	return result;
+}
+
+bool StyledTextLayout::renderToChannel(ci::Channel8u & channel, std::vector<RunColor> * runColors) {
+	const ci::ivec2 bitmapSize = getRenderSize();
+
+	// Odd failure - keep the existing channel
+	if (bitmapSize.x < 0 || bitmapSize.y < 0) {
+		return false;
+	}
+
+	bool didAllocate = false;
+
+	if (!channel.getData() || channel.getSize() != bitmapSize) {
+		channel = ci::Channel8u(bitmapSize.x, bitmapSize.y);
+		didAllocate = true;
+	}
+
+	mHasInvalidRender = false;
+
+	validateSize();
+	const auto commands = buildDrawCommands((float)bitmapSize.x);
+	mBackend->renderCoverage(channel, commands);
+
+	if (runColors) {
+		runColors->clear();
+		runColors->reserve(commands.size());
+
+		for (const auto & command : commands) {
+			RunColor runColor;
+			runColor.mBounds = ci::Rectf(command.mOrigin, command.mOrigin + command.mSize);
+			runColor.mColor = command.mColor;
+			runColors->push_back(runColor);
+		}
+	}
+
+	return didAllocate;
+}
+
+std::shared_future<ci::Surface8u> StyledTextLayout::renderToSurfaceAsync(bool useAlpha, bool premultiplied, const ci::ColorA8u & clearColor, AsyncRenderCallback callback) {
+	const ci::ivec2 bitmapSize = getRenderSize();
+
+	// remove completed renders
+	mPendingAsyncRenders.erase(std::remove_if(mPendingAsyncRenders.begin(), mPendingAsyncRenders.end(), [](const std::shared_future<ci::Surface8u> & render) {
+		return render.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	}), mPendingAsyncRenders.end());
+
+	// Odd failure - return a NULL Surface
+	if (bitmapSize.x < 0 || bitmapSize.y < 0) {
+		std::promise<ci::Surface8u> result;
+		result.set_value(ci::Surface8u());
+		return result.get_future().share();
+	}
+
+	// immutable snapshot so that the layout can change while rendering
+	auto result = getLayoutResult();
+	mHasInvalidRender = false;
+
+	const uint64_t renderId = ++mNumAsyncRenders;
+	auto state = mAsyncRenderState;
+	auto backend = mBackend;
+	auto pool = mSurfacePool;
+
+	auto task = make_shared<packaged_task<ci::Surface8u()>>([=]() {
+		ci::Surface8u surface = pool ? pool->acquire(bitmapSize, useAlpha, backend) : backend->createSurface(bitmapSize, useAlpha);
+		surface.setPremultiplied(premultiplied);
+		result->render(surface, backend, clearColor);
+
+		ci::Surface8u replacedSurface;
+
+		{
+			// swap in as front surface unless a newer render completed first
+			lock_guard<mutex> lock(state->mMutex);
+			if (renderId > state->mFrontId) {
+				if (state->mIsFrontSurfaceReleased) {
+					replacedSurface = state->mFrontSurface;
+				}
+				state->mFrontSurface = surface;
+				state->mFrontId = renderId;
+				state->mHasNewSurface = true;
+				state->mIsFrontSurfaceReleased = false;
+			}
+		}
+
+		if (pool && replacedSurface) {
+			// the consumer is done with the previous front surface, so it can be recycled for the next render
+			pool->release(replacedSurface);
+		}
+
+		if (callback) {
+			callback(surface);
+		}
+
+		return surface;
+	});
+
+	auto render = task->get_future().share();
+	mPendingAsyncRenders.push_back(render);
+
+	auto workerPool = mWorkerPool ? mWorkerPool : WorkerPool::get();
+	workerPool->submit([task]() { (*task)(); });
+
+	return render;
+}
+
+ci::Surface8u StyledTextLayout::getAsyncSurface() {
+	lock_guard<mutex> lock(mAsyncRenderState->mMutex);
+	mAsyncRenderState->mHasNewSurface = false;
+	return mAsyncRenderState->mFrontSurface;
+}
+
+bool StyledTextLayout::hasNewAsyncSurface() const {
+	lock_guard<mutex> lock(mAsyncRenderState->mMutex);
+	return mAsyncRenderState->mHasNewSurface;
+}
+
+void StyledTextLayout::releaseAsyncSurface(const ci::Surface8u & surface) {
+	if (!mSurfacePool || !surface) {
+		return;
+	}
+
+	{
+		// the front surface can still be returned by getAsyncSurface(), so defer until it's replaced
+		lock_guard<mutex> lock(mAsyncRenderState->mMutex);
+		if (mAsyncRenderState->mFrontSurface && mAsyncRenderState->mFrontSurface.getData() == surface.getData()) {
+			mAsyncRenderState->mIsFrontSurfaceReleased = true;
+			return;
+		}
+	}
+
+	mSurfacePool->release(surface);
+}
+
+void StyledTextLayout::renderInto(ci::Surface8u & surface, const ci::ColorA8u & clearColor) {
+	validateSize();
+	mHasInvalidRender = false;
+
+	mBackend->renderText(surface, buildDrawCommands((float)surface.getWidth()), clearColor);
+}
+
+vector<TextBackend::DrawCommand> StyledTextLayout::buildDrawCommands(const float maxWidth) {
+	return buildDrawCommands(maxWidth, 0, mLines.size(), 0.0f);
+}
+
+vector<TextBackend::DrawCommand> StyledTextLayout::buildDrawCommands(const float maxWidth, const size_t firstLine, const size_t lastLine, const float offsetY) {
+	vector<TextBackend::DrawCommand> commands;
+
+	for (size_t i = firstLine; i < lastLine && i < mLines.size(); ++i) {
+		const auto & line = mLines[i];
+		const float currentY = mLineOffsets[i] - offsetY + line->getLeadingOffset() + line->getLeading();
+
+		float currentX = mPaddingLeft;
 
 		if (line->getTextAlign() == TextAlign::Center) {
 			currentX = (maxWidth - line->getSize().x) * 0.5f;
@@ -527,27 +967,174 @@ ci::Surface	StyledTextLayout::renderToSurface(bool useAlpha, bool premultiplied,
 		}
 
 		for (const auto & run : line->getRuns()) {
-			const ci::ColorA8u & color = run->getColor();
-			const Gdiplus::Font * font = run->getFont().getGdiplusFont();
-			const Gdiplus::SolidBrush brush(Gdiplus::Color(color.a, color.r, color.g, color.b));
-			const Gdiplus::PointF origin(currentX, currentY + (line->getAscent() - run->getFont().getAscent()));
-			const Gdiplus::CharacterRange range(0, (int)run->getText().length());
-			auto & format = DeviceContextManager::instance()->getStringFormat();
-			format.SetMeasurableCharacterRanges(1, &range);
-			offscreenGraphics->DrawString(run->getText().c_str(), -1, font, origin, &format, &brush);
+			TextBackend::DrawCommand command;
+			command.mText = run->getText();
+			command.mFont = run->getFont();
+			command.mColor = run->getColor();
+			command.mOrigin = ci::vec2(currentX, currentY + (line->getAscent() - run->getAscent()));
+			command.mSize = run->getSize();
+			commands.push_back(command);
 			currentX += run->getSize().x;
 		}
+	}
+
+	return commands;
+}
+
+LayoutResultRef StyledTextLayout::getLayoutResult() {
+	validateSize();
+
+	if (!mHasInvalidLayoutResult) {
+		return std::atomic_load(&mLayoutResult);
+	}
+
+	auto result = buildLayoutResult();
+	std::atomic_store(&mLayoutResult, result);
+	mHasInvalidLayoutResult = false;
+	return result;
+}
+
+LayoutResultRef StyledTextLayout::getPublishedLayoutResult() const {
+	return std::atomic_load(&mLayoutResult);
+}
+
+LayoutResultRef StyledTextLayout::buildLayoutResult() {
+	auto result = shared_ptr<LayoutResult>(new LayoutResult());
+
+	result->mTextSize = mTextSize;
+	result->mPaddingTop = mPaddingTop;
+	result->mPaddingRight = mPaddingRight;
+	result->mPaddingBottom = mPaddingBottom;
+	result->mPaddingLeft = mPaddingLeft;
+
+	size_t numRuns = 0;
+	size_t textLength = 0;
+	for (const auto & line : mLines) {
+		numRuns += line->getRuns().size();
+		for (const auto & run : line->getRuns()) {
+			textLength += run->getText().length();
+		}
+	}
+
+	result->mText.reserve(textLength);
+	result->mRuns.reserve(numRuns);
+	result->mLines.reserve(mLines.size());
+
+	result->mLineOffsets = mLineOffsets;
 
-		currentY += line->getAscent() + line->getDescent();
+	MonotonicArena & arena = MonotonicArena::getThreadLocal();
+	MonotonicArena::Scope arenaScope(arena);
+
+	// fonts and colors are shared by index across runs; fonts are keyed by their resolved face since names aren't unique
+	typedef pair<const void *, float> FontKey;
+	typedef tuple<float, float, float, float> ColorKey;
+	ArenaMap<FontKey, uint32_t> fontIds{ArenaAllocator<pair<const FontKey, uint32_t>>(arena)};
+	ArenaMap<ColorKey, uint32_t> colorIds{ArenaAllocator<pair<const ColorKey, uint32_t>>(arena)};
+
+	for (const auto & line : mLines) {
+		LayoutResult::LineRecord lineRecord;
+		lineRecord.mFirstRun = (uint32_t)result->mRuns.size();
+		lineRecord.mNumRuns = (uint32_t)line->getRuns().size();
+		lineRecord.mTextAlign = line->getTextAlign();
+		lineRecord.mSize = line->getSize();
+		lineRecord.mLeadingOffset = line->getLeadingOffset();
+		lineRecord.mAscent = line->getAscent();
+		lineRecord.mDescent = line->getDescent();
+		lineRecord.mLeading = line->getLeading();
+
+		for (const auto & run : line->getRuns()) {
+			const auto & font = run->getFont();
+			const auto & color = run->getColor();
+
+			const auto fontKey = FontKey(mBackend->getFontHandle(font), font.getSize());
+			auto fontIt = fontIds.find(fontKey);
+			if (fontIt == fontIds.end()) {
+				LayoutResult::FontRecord fontRecord;
+				fontRecord.mFont = font;
+				fontRecord.mMetrics.mAscent = run->getAscent();
+				fontRecord.mMetrics.mDescent = run->getDescent();
+				fontRecord.mMetrics.mLeading = run->getLeading();
+				fontIt = fontIds.insert(make_pair(fontKey, (uint32_t)result->mFonts.size())).first;
+				result->mFonts.push_back(fontRecord);
+			}
+
+			const auto colorKey = make_tuple(color.r, color.g, color.b, color.a);
+			auto colorIt = colorIds.find(colorKey);
+			if (colorIt == colorIds.end()) {
+				colorIt = colorIds.insert(make_pair(colorKey, (uint32_t)result->mColors.size())).first;
+				result->mColors.push_back(color);
+			}
+
+			LayoutResult::RunRecord runRecord;
+			runRecord.mTextOffset = (uint32_t)result->mText.length();
+			runRecord.mTextLength = (uint32_t)run->getText().length();
+			runRecord.mFontId = fontIt->second;
+			runRecord.mColorId = colorIt->second;
+			runRecord.mAdvance = run->getSize().x;
+			runRecord.mHeight = run->getSize().y;
+			result->mText.append(run->getText());
+			result->mRuns.push_back(runRecord);
+		}
+
+		result->mLines.push_back(lineRecord);
 	}
 
-	GdiFlush();
+	return result;
+}
 
-	delete offscreenBitmap;
-	delete offscreenGraphics;
+ci::Surface StyledTextLayout::renderRangeToSurface(const float offsetY, const float height, bool useAlpha, bool premultiplied, const ci::ColorA8u & clearColor) {
+	ci::Surface result;
+	renderRangeToSurface(result, offsetY, height, useAlpha, premultiplied, clearColor);
 	return result;
 }
 
+bool StyledTextLayout::renderRangeToSurface(ci::Surface8u & surface, const float offsetY, const float height, bool useAlpha, bool premultiplied, const ci::ColorA8u & clearColor) {
+	validateSize();
+
+	const ci::ivec2 bitmapSize(getTextWidth(), (int)ci::math<float>::ceil(height));
+
+	if (bitmapSize.x <= 0 || bitmapSize.y <= 0) {
+		return false;
+	}
+
+	bool didAllocate = false;
+
+	if (!surface.getData() || surface.getSize() != bitmapSize || surface.hasAlpha() != useAlpha || !mBackend->isSurfaceCompatible(surface)) {
+		reallocateSurface(surface, bitmapSize, useAlpha);
+		didAllocate = true;
+	}
+
+	surface.setPremultiplied(premultiplied);
+	mHasInvalidRender = false;
+
+	// only lines that overlap [offsetY, offsetY + height)
+	const size_t firstLine = getLineIndexAtY(offsetY);
+	const auto lastLineIt = std::lower_bound(mLineOffsets.begin(), mLineOffsets.end(), offsetY + height);
+	const size_t lastLine = std::max(firstLine, std::min((size_t)(lastLineIt - mLineOffsets.begin()), mLines.size()));
+
+	mBackend->renderText(surface, buildDrawCommands((float)bitmapSize.x, firstLine, lastLine, offsetY), clearColor);
+
+	return didAllocate;
+}
+
+const std::vector<float> & StyledTextLayout::getLineOffsets() {
+	validateSize();
+	return mLineOffsets;
+}
+
+size_t StyledTextLayout::getLineIndexAtY(const float y) {
+	validateSize();
+
+	if (mLines.empty()) {
+		return 0;
+	}
+
+	// first offset greater than y is the bottom of the line at y
+	const auto it = std::upper_bound(mLineOffsets.begin(), mLineOffsets.end(), y);
+	const size_t index = it == mLineOffsets.begin() ? 0 : (size_t)(it - mLineOffsets.begin()) - 1;
+	return std::min(index, mLines.size() - 1);
+}
+
 
 //==================================================
 // Internal helpers
@@ -557,14 +1144,75 @@ void StyledTextLayout::invalidate(const bool layout, const bool size) {
 	if (size) mHasInvalidSize = true;
 }
 
+void StyledTextLayout::invalidateClipHeight() {
+	if (mHasTruncatedLines) {
+		// truncated lines might become visible
+		invalidateLineBreaks();
+	} else {
+		invalidate(false, true);
+	}
+}
+
+void StyledTextLayout::clearLines() {
+	mLines.clear();
+	mLineSegmentIndices.clear();
+	mCompletedLinesHeight = 0.0f;
+	mHasTruncatedLines = false;
+}
+
+bool StyledTextLayout::hasReachedClipHeight() {
+	if (mClipMode != Clip || mMaxSize.y < 0.0f || mLines.empty()) {
+		return false;
+	}
+
+	const auto & lastLine = mLines.back();
+	const float height = mPaddingTop + mPaddingBottom + mCompletedLinesHeight + lastLine->getHeight();
+	return height >= mMaxSize.y;
+}
+
+void StyledTextLayout::invalidateLineBreaks() {
+	mHasInvalidLineBreaks = true;
+	mHasInvalidSize = true;
+}
+
 void StyledTextLayout::validateLayout() {
-	if (!mHasInvalidLayout) {
+	if (!mHasInvalidLayout && mHasInvalidLineBreaks && mMeasuredSegments.size() <= mSegments.size()) {
+		MonotonicArena::Scope arenaScope(MonotonicArena::getThreadLocal());
+
+		// only re-break lines from cached tokens and advances
+		mHasInvalidLineBreaks = false;
+		clearLines();
+
+		for (size_t i = 0; i < mSegments.size() && !mHasTruncatedLines; ++i) {
+			if (i >= mMeasuredSegments.size()) {
+				// segment was skipped while lines were truncated
+				mMeasuredSegments.push_back(measureSegment(mSegments[i]));
+			}
+			breakSegment(mSegments[i], mMeasuredSegments[i], i);
+		}
+
+		evictSegments();
+		invalidate(false, true);
 		return;
 	}
 
-	// re-apply all segments using a copy of existing segments
-	vector<StyledText> segmentsCopy(mSegments.begin(), mSegments.end());
-	setSegments(segmentsCopy);
+	if (!mHasInvalidLayout && !mHasInvalidLineBreaks) {
+		return;
+	}
+
+	MonotonicArena::Scope arenaScope(MonotonicArena::getThreadLocal());
+
+	// re-apply all segments; existing segments are moved out instead of copied
+	mHasInvalidLineBreaks = false;
+	SegmentList segments;
+	segments.swap(mSegments);
+
+	const auto baseStyle = mCurrentStyle;
+	clearText();
+	for (const auto & segment : segments) {
+		appendSegment(segment);
+	}
+	setCurrentStyle(baseStyle);
 
 	mHasInvalidLayout = false;
 }
@@ -578,6 +1226,14 @@ void StyledTextLayout::validateSize() {
 
 	mTextSize = ci::ivec2(0, 0);
 
+	// Prefix table of rendered line positions for visible range lookups
+	mLineOffsets.resize(mLines.size() + 1);
+	mLineOffsets[0] = mPaddingTop;
+
+	for (size_t i = 0; i < mLines.size(); ++i) {
+		mLineOffsets[i + 1] = mLineOffsets[i] + mLines[i]->getHeight();
+	}
+
 	// Make sure padding doesn't exceed max width
 	if (mMaxSize.x < 0.0f || mPaddingLeft + mPaddingRight <= mMaxSize.x) {
 
@@ -620,13 +1276,57 @@ void StyledTextLayout::validateSize() {
 	}
 
 	mHasInvalidSize = false;
+	mHasInvalidLayoutResult = true;
 }
 
-void StyledTextLayout::modifyStyles(bool updateExistingText, std::function<void(Style& style)> fn) {
-	if (updateExistingText) {
+void StyledTextLayout::modifyStyles(bool updateExistingText, std::function<void(Style& style)> fn, StyleChange change) {
+	if (updateExistingText && change == StyleChange::Paint) {
+		// colors are kept on segments and runs instead of interning a new style for every change (e.g. when animating colors)
+		for (auto& segment : mSegments) {
+			Style style;
+			style.mColor = segment.getColor();
+			fn(style);
+			segment.mColor = style.mColor;
+			segment.mHasColor = true;
+		}
+
+		// geometry is unchanged, so patch existing runs in place and only mark the rendered text as invalid
+		for (auto& line : mLines) {
+			for (auto& run : line->getRuns()) {
+				run->modifyPaintStyle(fn);
+			}
+		}
+		mHasInvalidRender = true;
+		mHasInvalidLayoutResult = true;
+
+	} else if (updateExistingText) {
+		MonotonicArena & arena = MonotonicArena::getThreadLocal();
+		MonotonicArena::Scope arenaScope(arena);
+
+		// segments share interned styles, so each distinct style is only modified and interned once
+		StyleTable & styleTable = *StyleTable::get();
+		ArenaMap<StyleId, StyleId> modifiedIds{ArenaAllocator<pair<const StyleId, StyleId>>(arena)};
+
 		for (auto& segment : mSegments) {
-			fn(segment.mStyle);
+			auto it = modifiedIds.find(segment.mStyleId);
+
+			if (it == modifiedIds.end()) {
+				Style style(segment.getStyle());
+				fn(style);
+				it = modifiedIds.insert(make_pair(segment.mStyleId, styleTable.intern(style, segment.mStyleId))).first;
+			}
+
+			segment.mStyleId = it->second;
+
+			if (segment.mHasColor) {
+				// the segment's own color overrides the interned one, so fn has to see and update it as well
+				Style style;
+				style.mColor = segment.mColor;
+				fn(style);
+				segment.mColor = style.mColor;
+			}
 		}
+
 		invalidate();
 	}
 	fn(mCurrentStyle);
@@ -635,5 +1335,3 @@ void StyledTextLayout::modifyStyles(bool updateExistingText, std::function<void(
 
 }
 }
-
-#endif
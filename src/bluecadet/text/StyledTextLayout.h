@@ -28,12 +28,21 @@
 
 #include "cinder/Cinder.h"
 #include "cinder/Surface.h"
+#include "cinder/Channel.h"
+#include "cinder/Rect.h"
 #include "cinder/Font.h"
 
 #include <vector>
+#include <deque>
 #include <string>
+#include <future>
+#include <mutex>
 
 #include "Text.h"
+#include "TextBackend.h"
+#include "SurfacePool.h"
+#include "LayoutResult.h"
+#include "WorkerPool.h"
 
 namespace bluecadet {
 namespace text {
@@ -45,26 +54,35 @@ public:
 
 	class Run {
 	public:
-		Run(const Style style, const ci::Font & aFont, const ci::ColorA & aColor);
+		Run(const ci::Font & aFont, const ci::ColorA & aColor, TextBackendRef backend);
 		~Run();
 
-		inline const Style &					getStyle() const { return mStyle; }
 		inline const ci::vec2 &					getSize() { calcExtents(); return mSize; };
 		inline const StringType &				getText() const { return mWideText; }
 		inline const ci::ColorA &				getColor() const { return mColor; }
 		inline const ci::Font &					getFont() const { return mFont; }
+		inline float							getAscent() const { return mMetrics.mAscent; }
+		inline float							getDescent() const { return mMetrics.mDescent; }
+		inline float							getLeading() const { return mMetrics.mLeading; }
 
 		void append(const StringType & text);
+		void append(const CharType * text, const size_t length);
 		void setText(const StringType & text);
+		//! Removes all characters after length.
+		void truncate(const size_t length);
 		void calcExtents();
 
+		//! Applies a style change that doesn't affect geometry (e.g. color) without invalidating extents.
+		void modifyPaintStyle(const std::function<void(Style & style)> & fn);
+
 	protected:
 		bool mHasInvalidExtents;
-		Style mStyle;
 		ci::Font mFont;
 		ci::ColorA mColor;
 		StringType mWideText;
 		ci::vec2 mSize;
+		TextBackendRef mBackend;
+		TextBackend::FontMetrics mMetrics;
 	};
 	typedef std::shared_ptr<Run> RunRef;
 
@@ -81,6 +99,8 @@ public:
 		inline float						getDescent() { calcExtents(); return mDescent; };
 		inline float						getLeading() { calcExtents(); return mLeading; };
 		inline float						getAscent() { calcExtents(); return mAscent; };
+		//! The vertical space taken up by the line when rendered, including its leading offset. Used for line offsets and clipping.
+		inline float						getHeight() { calcExtents(); return mLeadingOffset + mLeading + mAscent + mDescent; }
 
 		void addRun(const RunRef run);
 		void calcExtents();
@@ -96,6 +116,10 @@ public:
 	};
 	typedef std::shared_ptr<Line> LineRef;
 
+	//! Segments and lines are stored in deques so that the oldest entries can be evicted in constant time when a max number of lines is set.
+	typedef std::deque<StyledText> SegmentList;
+	typedef std::deque<LineRef> LineList;
+
 	enum LayoutMode {
 		WordWrap,	//! Default: Wraps automatically at max width. Will keep words that are longer than max wdith on a single line, but not break them.
 		NoWrap,		//! Does not wrap automatically but respects explicit line breaks.
@@ -124,10 +148,67 @@ public:
 	//! Returns a ci::Surface into which the StyledTextLayout is rendered. If \a useAlpha the ci::Surface will contain an alpha channel. If \a premultiplied the alpha will be premulitplied.
 	ci::Surface renderToSurface(bool useAlpha = true, bool premultiplied = false, const ci::ColorA8u & clearColor = ci::ColorA8u());
 
-	//! Returns true if the current size or layouts are invalid and require a call to getSurface()
+	//! Renders into an existing surface. The surface is only re-allocated if its size or alpha don't match getRenderSize() or if the backend can't draw into it. Returns true if the surface was re-allocated.
+	bool renderToSurface(ci::Surface8u & surface, bool useAlpha = true, bool premultiplied = false, const ci::ColorA8u & clearColor = ci::ColorA8u());
+
+	//! Renders into caller-owned pixel memory of at least getRenderSize().y * rowBytes bytes. The channel order has to be supported by the backend (BGRA or BGR on Windows). Returns false if nothing was rendered.
+	bool renderToSurface(uint8_t * data, int32_t rowBytes, const ci::SurfaceChannelOrder & channelOrder, bool premultiplied = false, const ci::ColorA8u & clearColor = ci::ColorA8u());
+
+	//! Renders only lines overlapping the vertical range [offsetY, offsetY + height) into a surface that is getTextWidth() wide and \a height tall. Useful to scroll long text without rendering all of it.
+	ci::Surface renderRangeToSurface(const float offsetY, const float height, bool useAlpha = true, bool premultiplied = false, const ci::ColorA8u & clearColor = ci::ColorA8u());
+
+	//! Renders a vertical range into an existing surface, which is only re-allocated if its size, alpha or format don't match. Returns true if the surface was re-allocated.
+	bool renderRangeToSurface(ci::Surface8u & surface, const float offsetY, const float height, bool useAlpha = true, bool premultiplied = false, const ci::ColorA8u & clearColor = ci::ColorA8u());
+
+	//! Called once an async render has completed, either on a WorkerPool thread or inline on the calling thread if the pool has no threads.
+	//! Must not access the layout, which may be modified or destroyed concurrently.
+	typedef std::function<void(ci::Surface8u surface)> AsyncRenderCallback;
+
+	//! Snapshots the current lines and runs and rasterizes them on the worker pool (see setWorkerPool()). The layout can be modified while rendering.
+	//! Renders synchronously if the worker pool has no threads (e.g. on single-core machines).
+	//! Completed surfaces are swapped in as the front surface (see getAsyncSurface()) unless a newer render has completed already.
+	//! When a surface pool is set, completed surfaces are only recycled once they're handed back via releaseAsyncSurface().
+	//! The returned future and the optional callback receive the rendered surface. Destroying the layout waits for pending async renders.
+	std::shared_future<ci::Surface8u> renderToSurfaceAsync(bool useAlpha = true, bool premultiplied = false, const ci::ColorA8u & clearColor = ci::ColorA8u(), AsyncRenderCallback callback = nullptr);
+
+	//! The most recently completed surface of renderToSurfaceAsync(). Empty until the first async render completes.
+	ci::Surface8u getAsyncSurface();
+
+	//! True if a newer async surface has completed since the last call to getAsyncSurface().
+	bool hasNewAsyncSurface() const;
+
+	//! Hands a surface from renderToSurfaceAsync() or getAsyncSurface() back to the surface pool once it's no longer used (e.g. after uploading it to a texture).
+	//! All copies of the surface, including those held by futures and callbacks, must be done with it. The current front surface is only released once a newer render replaces it.
+	//! Does nothing if no surface pool is set.
+	void releaseAsyncSurface(const ci::Surface8u & surface);
+
+	//! Bounds and color of a single run rendered by renderToChannel().
+	struct RunColor {
+		ci::Rectf	mBounds;
+		ci::ColorA	mColor;
+	};
+
+	//! Renders only the 8-bit coverage of all text into a single channel, e.g. to upload an alpha texture and tint it in a shader. Run colors are ignored, but can be retrieved via \a runColors for multi-color text.
+	ci::Channel8u renderToChannel(std::vector<RunColor> * runColors = nullptr);
+
+	//! Renders coverage into an existing channel, which is only re-allocated if its size doesn't match getRenderSize(). Returns true if the channel was re-allocated.
+	bool renderToChannel(ci::Channel8u & channel, std::vector<RunColor> * runColors = nullptr);
+
+	//! Returns the size of surfaces rendered by renderToSurface(). If the StyledTextLayout has changes calling this method will trigger internal recalculations.
+	ci::ivec2 getRenderSize();
+
+	//! Optional pool to recycle surfaces between renders. Defaults to nullptr. Surfaces returned by renderToSurface() can be handed back via SurfacePool::release() once they're no longer needed.
+	//! When re-allocating a surface passed to renderToSurface() or renderRangeToSurface(), the old surface is only returned to the pool if this layout acquired it; caller-owned surfaces are never pooled.
+	void setSurfacePool(SurfacePoolRef pool);
+	inline SurfacePoolRef getSurfacePool() const { return mSurfacePool; }
+
+	//! Returns true if the current size or layouts are invalid or if paint-only styles changed since the last call to renderToSurface()
 	bool hasChanges() const;
 
 
+	// std::string text is expected to be UTF-8 and std::wstring text to be UTF-16/32. Text is stored as StringType,
+	// which is UTF-8 if BLUECADET_TEXT_USE_UTF8 is defined. Passing text in the same encoding avoids a conversion.
+
 	//! Replaces the current text and keeps the current style. Parses supported style tags.
 	void setText(const std::string & text, const TokenParserMapRef customTokenParsers = nullptr);
 	//! Replaces the current text and and sets the current style by loading it from the StyleManager. Parses supported style tags.
@@ -185,6 +266,11 @@ public:
 	//! Appends text to any existing text and and sets the current style. Text will not be parsed for style tags, making this method slightly more efficient than its text counterpart.
 	void appendPlainText(const std::wstring & text, const Style& style, bool saveAsCurrentStyle = false);
 
+	//! Replaces the current text with the contents of a UTF-8 file and keeps the current style. Parses supported style tags. Returns false if the file can't be read.
+	bool setTextFile(const ci::fs::path & path, const TokenParserMapRef customTokenParsers = nullptr);
+	//! Appends the contents of a UTF-8 file. The file is memory-mapped and parsed in chunks, and segments are laid out as soon as they're parsed. Returns false if the file can't be read.
+	bool appendTextFile(const ci::fs::path & path, const TokenParserMapRef customTokenParsers = nullptr);
+
 
 
 	//! Defaults to \a WordWrap but only applies if a max width is set
@@ -203,7 +289,7 @@ public:
 	virtual float getMaxWidth() const;
 	virtual void setMaxWidth(const float value);
 
-	//! Max height to use in combination with layout Clip. If Clip is enabled and maxHeight is > 0, then text will be clipped at maxHeight.
+	//! Max height to use in combination with layout Clip. If Clip is enabled and maxHeight is > 0, then text will be clipped at maxHeight. Lines below maxHeight won't be laid out until maxHeight increases.
 	virtual float getMaxHeight() const;
 	virtual void setMaxHeight(const float value);
 
@@ -287,44 +373,156 @@ public:
 	inline void appendSegments(const std::vector<StyledText> & segments);
 
 	//! Returns all of the current segments of text
-	inline const std::vector<StyledText> & getSegments() const;
+	inline const SegmentList & getSegments() const;
 
 	//! Returns all lines
-	inline const std::vector<LineRef> & getLines() { validateSize(); return mLines; }
+	inline const LineList & getLines() { validateSize(); return mLines; }
+
+	//! Limits the number of lines kept in memory for streaming text (e.g. live feeds that are appended to indefinitely). When exceeded, the oldest lines and any segments that are no longer visible on a line are evicted. Defaults to 0, which keeps all lines.
+	//! Works best with NoClip or without a max height, since Clip mode stops adding lines once max height is reached.
+	void setMaxNumLines(const size_t value);
+	inline size_t getMaxNumLines() const { return mMaxNumLines; }
+
+	//! Returns the rendered top of each line (including padding), followed by the bottom of the last line. Contains getLines().size() + 1 values. Valid until the layout changes.
+	const std::vector<float> & getLineOffsets();
+
+	//! Returns the index of the line at \a y using a binary search over the line offsets. Clamps to the first and last line.
+	size_t getLineIndexAtY(const float y);
+
+	//! Returns an immutable snapshot of the current layout, creating a new one if anything changed since the last call. New results are also published to getPublishedLayoutResult().
+	//! Snapshots are copies that are only created when requested (and for async renders); synchronous rendering reads the layout directly.
+	LayoutResultRef getLayoutResult();
+
+	//! Returns the most recently created layout result without validating anything. Lock-free and safe to call from any thread, e.g. to render on a different thread than the one modifying this layout. Returns nullptr if no result has been created yet.
+	LayoutResultRef getPublishedLayoutResult() const;
 
 	//! The options used when parsing text. Defaults to the default text parser options at creation of this StyledTextLayout.
 	inline void setParseOptions(int options) { mParseOptions = options; }
 	inline int getParseOptions() const { return mParseOptions; }
 
+	//! When enabled, text passed to setText() and appendText() is split at paragraph boundaries (see StyledTextParser::splitParagraphs())
+	//! and paragraphs are parsed, measured and broken into lines concurrently on the worker pool. The lines of all paragraphs are then stitched together in order.
+	//! Falls back to sequential layout if lines are clipped at a max height or in SingleLine and StripBreaks modes. Only worth it for long texts. Defaults to false.
+	inline void setParallelParagraphsEnabled(const bool value) { mParallelParagraphsEnabled = value; }
+	inline bool getParallelParagraphsEnabled() const { return mParallelParagraphsEnabled; }
+
+	//! Pool used to lay out paragraphs in parallel and to run async renders. Defaults to nullptr, which uses WorkerPool::get().
+	inline void setWorkerPool(WorkerPoolRef pool) { mWorkerPool = pool; }
+	inline WorkerPoolRef getWorkerPool() const { return mWorkerPool; }
+
+	//! The backend used to measure and render text. Defaults to TextBackend::getDefault().
+	void setBackend(TextBackendRef backend);
+	inline TextBackendRef getBackend() const { return mBackend; }
+
 	//! The hinting style used by GDI to render text
 	//inline void setRenderingHint(Gdiplus::TextRenderingHint value) { mRenderingHint = value; }
 	//inline Gdiplus::TextRenderingHint getRenderingHint() const { return mRenderingHint; }
 
 protected:
+	//! Tokens and advances of a single segment after text transforms were applied. Retained per segment so that line breaks can be recalculated without re-tokenizing or re-measuring text (e.g. when only the max width changes).
+	struct MeasuredSegment {
+		//! Range of a single token in mText
+		struct Token {
+			uint32_t	mOffset;
+			uint32_t	mLength;
+			float		mAdvance;
+			bool		mIsNewline;
+			bool		mIsWhitespace;
+		};
+		StringType			mText;
+		ci::Font			mFont;
+		std::vector<Token>	mTokens;
+	};
+
 	//! Marks the current size and layout as invalid. Call this method when making any style or content changes to queue a validation when necessary.
 	virtual inline void invalidate(const bool layout = true, const bool size = true);
 
+	//! Marks line breaks and size as invalid, but keeps the measured segments. Call this method when making changes that only affect where lines break (e.g. max width, padding or layout mode).
+	void		invalidateLineBreaks();
+
 	//! Recalculates the current layout by clearing all content and re-adding it if the current layout is invalid.
-	inline void	validateLayout();
+	void		validateLayout();
 
 	//! Recalculates the current size if the size is currently invalid.
-	inline void	validateSize();
+	void		validateSize();
+
+	//! Layout changes affect geometry (font family, size, weight, style, transform, leading, alignment) and require a new layout. Paint changes (color, alpha) only require existing text to be rendered again.
+	enum class StyleChange { Layout, Paint };
+
+	//! Helper to modify all styles of existing segments and the current style. Paint changes are applied to existing runs in place.
+	void		modifyStyles(bool updateExistingText, std::function<void(Style & style)> fn, StyleChange change = StyleChange::Layout);
+
+	//! Invalidates the size after changing the clip height. Resumes line breaking if lines have been truncated before.
+	void		invalidateClipHeight();
+
+	//! Removes all lines and resets clip height tracking.
+	void		clearLines();
+
+	//! Returns true if the current lines fill the max height in Clip mode. Lines added beyond that wouldn't be visible.
+	bool		hasReachedClipHeight();
+
+	//! Transforms, tokenizes and measures the text of a segment.
+	MeasuredSegment	measureSegment(const StyledText & segment);
 
-	//! Helper to modify all styles of existing segments and the current style
-	void		modifyStyles(bool updateExistingText, std::function<void(Style & style)> fn);
+	//! Breaks a measured segment into runs and lines and appends them to the existing lines. segmentIndex is the index of the segment in mSegments.
+	void		breakSegment(const StyledText & segment, const MeasuredSegment & measured, const size_t segmentIndex);
 
-	//! Adds a single, empty line with the current style and returns it.
-	std::shared_ptr<class Line>	addLine(const Style & style);
+	//! Removes the oldest lines beyond the max number of lines.
+	void		evictLines();
+
+	//! Removes the oldest segments that don't start any of the remaining lines. Has to be called after line breaking is complete since it shifts segment indices.
+	void		evictSegments();
+
+	//! Validates the layout and renders all lines into surface.
+	void		renderInto(ci::Surface8u & surface, const ci::ColorA8u & clearColor);
+
+	//! Replaces surface with a new one of size, acquired from the surface pool if set. The old surface is only released to the pool if it's the one this layout acquired last.
+	void		reallocateSurface(ci::Surface8u & surface, const ci::ivec2 & size, bool useAlpha);
+
+	//! Positions all runs of all lines within maxWidth.
+	std::vector<TextBackend::DrawCommand> buildDrawCommands(const float maxWidth);
+
+	//! Positions all runs of lines [firstLine, lastLine) within maxWidth and moves them up by offsetY.
+	std::vector<TextBackend::DrawCommand> buildDrawCommands(const float maxWidth, const size_t firstLine, const size_t lastLine, const float offsetY);
+
+	//! Copies the current lines, runs, metrics and size into a new, immutable result. Expects size to be valid.
+	LayoutResultRef	buildLayoutResult();
+
+	//! Parses text and appends its segments. Parses and lays out paragraphs in parallel if enabled.
+	void		appendParsedText(const StringType & text, const Style & style, const TokenParserMapRef customTokenParsers);
+
+	//! True if paragraphs can be broken into lines independently and stitched together afterwards, which requires valid lines that aren't clipped.
+	bool		canBreakParagraphsInParallel() const;
+
+	//! Creates an empty layout with the same line breaking properties as this one, but without clipping or line limits.
+	std::shared_ptr<StyledTextLayout>	createParagraphLayout() const;
+
+	//! Moves the segments and lines of a paragraph layout to the end of this layout. The paragraph's first line continues the last line like in breakSegment().
+	void		appendParagraphLayout(StyledTextLayout & paragraph);
+
+	//! Adds a single, empty line with the current style and returns it. segmentIndex is the index of the segment in mSegments that starts the line.
+	std::shared_ptr<class Line>	addLine(const Style & style, const size_t segmentIndex);
 
 
 
 	// Layout properties
 	bool		mHasInvalidLayout;
+	bool		mHasInvalidLineBreaks;
 	bool		mHasInvalidSize;
+	bool		mHasInvalidRender;
+	bool		mHasInvalidLayoutResult;
+	bool		mHasTruncatedLines;		//! True if line breaking stopped at the clip height; Remaining segments are pending
+	float		mCompletedLinesHeight;
 	ci::ivec2	mTextSize;
 
-	std::vector<StyledText> mSegments;
-	std::vector<std::shared_ptr<class Line>> mLines;
+	SegmentList mSegments;
+	std::deque<MeasuredSegment> mMeasuredSegments;
+	LineList mLines;
+	std::deque<size_t> mLineSegmentIndices;	//! Absolute index of the segment that starts each line
+	size_t mNumEvictedSegments;				//! Converts absolute segment indices to indices in mSegments
+	size_t mMaxNumLines;
+	std::vector<float> mLineOffsets;
+	LayoutResultRef mLayoutResult;	//! Only accessed via std::atomic_load/store since it's published to other threads
 
 	LayoutMode	mLayoutMode;
 	ClipMode	mClipMode;
@@ -333,6 +531,7 @@ protected:
 	// Styling properties
 	bool		mLeadingDisabled;
 	int			mParseOptions;
+	bool		mParallelParagraphsEnabled;
 
 	ci::vec2	mMaxSize;
 	float		mPaddingTop;
@@ -342,6 +541,22 @@ protected:
 	Style		mCurrentStyle;
 
 	// Rendering properties
+	TextBackendRef mBackend;
+	SurfacePoolRef mSurfacePool;
+	ci::Surface8u mPooledSurface;	//! Last surface acquired from mSurfacePool for in-place rendering. Retained so that its pixels can't be reused by an unrelated surface while it's tracked.
+	WorkerPoolRef mWorkerPool;
+
+	//! Front buffer of async renders. Shared with render threads so that they never access the layout itself.
+	struct AsyncRenderState {
+		std::mutex			mMutex;
+		ci::Surface8u		mFrontSurface;
+		uint64_t			mFrontId = 0;
+		bool				mHasNewSurface = false;
+		bool				mIsFrontSurfaceReleased = false;	//! Set by releaseAsyncSurface() if the front surface can be recycled once it's replaced
+	};
+	std::shared_ptr<AsyncRenderState> mAsyncRenderState;
+	uint64_t mNumAsyncRenders;
+	std::vector<std::shared_future<ci::Surface8u>> mPendingAsyncRenders;	//! Renders that haven't been observed as completed yet; waited for on destruction
 	//Gdiplus::TextRenderingHint mRenderingHint;;
 
 };
@@ -1,6 +1,14 @@
 #include "StyledTextParser.h"
 #include "cinder/Json.h"
 
+#include <algorithm>
+#include <set>
+#include <type_traits>
+
+#include "MappedFile.h"
+#include "StyleManager.h"
+#include "StyleTable.h"
+
 using namespace ci;
 using namespace ci::app;
 using namespace std;
@@ -8,124 +16,280 @@ using namespace std;
 namespace bluecadet {
 namespace text {
 
-StyledTextParser::StyledTextParser() {
-	mDefaultOptions = 0;
+//==================================================
+// Built-in tags
+//
+
+enum class BuiltInTag {
+	None,
+	Root,
+	ItalicStart,
+	BoldStart,
+	StyleEnd,
+	Break,
+	Paragraph,
+	LessThan,
+	GreaterThan,
+	LineBreak,
+	SpanStart
+};
+
+// Compares a lowercase token against an ASCII literal of the same length
+static inline bool equals(const CharType * token, const char * literal, const size_t length) {
+	for (size_t i = 0; i < length; ++i) {
+		if (token[i] != (CharType)literal[i]) return false;
+	}
+	return true;
+}
 
-	// Construct default token parsers
-	{
-		// root
-		TokenParserFn tokenParser = [](StringType token, const int options, std::vector<StyledText> &segments, std::stack<Style> &styles) {
-		};
+// Resolves lowercase tokens to built-in tags by switching on their length first, so each token is compared
+// against at most four candidates without hashing or allocating
+static BuiltInTag findBuiltInTag(const CharType * token, const size_t length) {
+	switch (length) {
+		case 1:
+			if (token[0] == '\n') return BuiltInTag::LineBreak;
+			break;
+		case 3:
+			if (equals(token, "<i>", 3)) return BuiltInTag::ItalicStart;
+			if (equals(token, "<b>", 3)) return BuiltInTag::BoldStart;
+			if (equals(token, "<p>", 3)) return BuiltInTag::Paragraph;
+			break;
+		case 4:
+			if (equals(token, "</i>", 4) || equals(token, "</b>", 4)) return BuiltInTag::StyleEnd;
+			if (equals(token, "</p>", 4)) return BuiltInTag::Paragraph;
+			if (equals(token, "<em>", 4)) return BuiltInTag::ItalicStart;
+			if (equals(token, "<br>", 4)) return BuiltInTag::Break;
+			if (equals(token, "&lt;", 4)) return BuiltInTag::LessThan;
+			if (equals(token, "&gt;", 4)) return BuiltInTag::GreaterThan;
+			break;
+		case 5:
+			if (equals(token, "</em>", 5)) return BuiltInTag::StyleEnd;
+			if (equals(token, "<br/>", 5)) return BuiltInTag::Break;
+			break;
+		case 6:
+			if (equals(token, "<root>", 6)) return BuiltInTag::Root;
+			if (equals(token, "<br />", 6)) return BuiltInTag::Break;
+			break;
+		case 7:
+			if (equals(token, "</root>", 7)) return BuiltInTag::Root;
+			if (equals(token, "</span>", 7)) return BuiltInTag::StyleEnd;
+			break;
+		case 8:
+			if (equals(token, "<strong>", 8)) return BuiltInTag::BoldStart;
+			break;
+		case 9:
+			if (equals(token, "</strong>", 9)) return BuiltInTag::StyleEnd;
+			break;
+	}
 
-		mDefaultTokenParsers[L"<root>"] = tokenParser;
-		mDefaultTokenParsers[L"</root>"] = tokenParser;
+	// span tags can have attributes, so only their name is matched
+	if (length >= 6 && equals(token, "<span", 5) && (token[5] == '>' || isSpace(token[5]))) {
+		return BuiltInTag::SpanStart;
 	}
 
-	{
-		// Italic
-		TokenParserFn tokenParser = [](StringType token, const int options, std::vector<StyledText> &segments, std::stack<Style> &styles) {
-			const bool shouldInvert = (options & INVERT_NESTED_ITALICS) && (styles.top().mFontStyle == FontStyle::Italic);
-			Style style = Style(styles.top()).fontStyle(shouldInvert ? FontStyle::Normal : FontStyle::Italic);
-			styles.push(style);
-		};
+	return BuiltInTag::None;
+}
 
-		mDefaultTokenParsers[L"<i>"] = tokenParser;
-		mDefaultTokenParsers[L"<em>"] = tokenParser;
+// Tags are ASCII, so only ASCII characters are lowercased
+static inline void toLowerAscii(StringType & token) {
+	for (auto & c : token) {
+		if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
 	}
+}
 
-	{
-		// Bold
-		TokenParserFn tokenParser = [](StringType token, const int options, std::vector<StyledText> &segments, std::stack<Style> &styles) {
-			Style style = Style(styles.top()).fontWeight(FontWeight::Bold);
-			styles.push(style);
-		};
+static inline StringType toLowerAscii(const StringType & token) {
+	StringType result(token);
+	toLowerAscii(result);
+	return result;
+}
 
-		mDefaultTokenParsers[L"<b>"] = tokenParser;
-		mDefaultTokenParsers[L"<strong>"] = tokenParser;
-	}
+// Longest text token that can match a built-in tag (&lt; and &gt;)
+static const size_t kMaxBuiltInTextTokenLength = 4;
 
-	{
-		// Remove styles from stack when tag is closed
-		TokenParserFn tokenParser = [](StringType token, const int options, std::vector<StyledText> &segments, std::stack<Style> &styles) {
-			if (!styles.empty()) styles.pop();
-		};
+// Built-in handlers use the same API as custom tag handlers
 
-		mDefaultTokenParsers[L"</i>"] = tokenParser;
-		mDefaultTokenParsers[L"</em>"] = tokenParser;
-		mDefaultTokenParsers[L"</b>"] = tokenParser;
-		mDefaultTokenParsers[L"</strong>"] = tokenParser;
-	}
+static void handleItalicStart(const StringViewType & /*token*/, StyledTextParser::SegmentBuilder & builder) {
+	StyleTable & styleTable = *StyleTable::get();
+	const bool shouldInvert = (builder.getOptions() & StyledTextParser::INVERT_NESTED_ITALICS) && (builder.getStyle().mFontStyle == FontStyle::Italic);
+	builder.pushStyle(shouldInvert ? styleTable.getUprightId(builder.getStyleId()) : styleTable.getItalicId(builder.getStyleId()));
+}
 
-	{
-		// Break
-		TokenParserFn tokenParser = [](StringType token, const int options, std::vector<StyledText> &segments, std::stack<Style> &styles) {
-			if (options & STRIP_BREAK_TAGS) {
-				return;
+static void handleBoldStart(const StringViewType & /*token*/, StyledTextParser::SegmentBuilder & builder) {
+	builder.pushStyle(StyleTable::get()->getBoldId(builder.getStyleId()));
+}
+
+static void handleStyleEnd(const StringViewType & /*token*/, StyledTextParser::SegmentBuilder & builder) {
+	builder.popStyle();
+}
+
+static void handleBreak(const StringViewType & /*token*/, StyledTextParser::SegmentBuilder & builder) {
+	if (!(builder.getOptions() & StyledTextParser::STRIP_BREAK_TAGS)) builder.emitBreak();
+}
+
+static void handleParagraph(const StringViewType & /*token*/, StyledTextParser::SegmentBuilder & builder) {
+	if (!(builder.getOptions() & StyledTextParser::STRIP_PARAGRAPH_TAG)) builder.emitBreak();
+}
+
+static void handleLessThan(const StringViewType & /*token*/, StyledTextParser::SegmentBuilder & builder) {
+	builder.emitText(BLUECADET_TEXT_STR("<"));
+}
+
+static void handleGreaterThan(const StringViewType & /*token*/, StyledTextParser::SegmentBuilder & builder) {
+	builder.emitText(BLUECADET_TEXT_STR(">"));
+}
+
+static void handleLineBreak(const StringViewType & /*token*/, StyledTextParser::SegmentBuilder & builder) {
+	if (!(builder.getOptions() & StyledTextParser::TRIM_LEADING_BREAKS) || builder.hasSegments()) builder.emitBreak();
+}
+
+// Returns the value of the class attribute of a tag like `<span id=a class="b c">` as a view into the tag, or an empty
+// view if there's no class attribute. Attribute names are matched case-insensitively, values are kept as is.
+static StringViewType findClassAttribute(const StringViewType & tag) {
+	const CharType * it = tag.data() + 1;
+	const CharType * end = tag.data() + tag.size();
+
+	// skip tag name
+	while (it != end && !isSpace(*it) && *it != '>' && *it != '/') ++it;
+
+	while (it != end) {
+		while (it != end && (isSpace(*it) || *it == '/')) ++it;
+		if (it == end || *it == '>') break;
+
+		const CharType * nameBegin = it;
+		while (it != end && !isSpace(*it) && *it != '=' && *it != '>' && *it != '/') ++it;
+		const CharType * nameEnd = it;
+
+		while (it != end && isSpace(*it)) ++it;
+
+		StringViewType value;
+
+		if (it != end && *it == '=') {
+			++it;
+			while (it != end && isSpace(*it)) ++it;
+
+			if (it != end && (*it == '"' || *it == '\'')) {
+				const CharType quote = *it++;
+				const CharType * valueBegin = it;
+				while (it != end && *it != quote) ++it;
+				value = StringViewType(valueBegin, it - valueBegin);
+				if (it != end) ++it;
 			} else {
-				token = L"\n";
-				StyledText segment(styles.top(), token);
-				segments.push_back(segment);
+				const CharType * valueBegin = it;
+				while (it != end && !isSpace(*it) && *it != '>') ++it;
+				value = StringViewType(valueBegin, it - valueBegin);
 			}
-		};
+		}
 
-		mDefaultTokenParsers[L"<br />"] = tokenParser;
-		mDefaultTokenParsers[L"<br/>"] = tokenParser;
-		mDefaultTokenParsers[L"<br>"] = tokenParser;
+		if (nameEnd - nameBegin == 5) {
+			CharType name[5];
+			for (size_t i = 0; i < 5; ++i) {
+				name[i] = (nameBegin[i] >= 'A' && nameBegin[i] <= 'Z') ? nameBegin[i] + ('a' - 'A') : nameBegin[i];
+			}
+			if (equals(name, "class", 5)) return value;
+		}
 	}
 
+	return StringViewType();
+}
+
+// Applies each known class in order. Unknown classes are skipped, but a style is always pushed so that the closing
+// span tag stays balanced.
+// Logs each unknown class name only once, since the same markup is typically parsed over and over (e.g. when
+// text is updated every frame). Built-in handlers don't have access to the parser, so the log is shared.
+static void warnUnknownStyleClass(const StringViewType & name) {
+	static std::mutex sMutex;
+	static std::set<StringType> sLoggedNames;
+
+	StringType nameString(name.data(), name.size());
+
 	{
-		// Paragraph
-		TokenParserFn tokenParser = [](StringType token, const int options, std::vector<StyledText> &segments, std::stack<Style> &styles) {
-			if (options & STRIP_PARAGRAPH_TAG) {
-				return;
-			} else {
-				token = L"\n";
-				StyledText segment(styles.top(), token);
-				segments.push_back(segment);
-			}
-		};
+		lock_guard<mutex> lock(sMutex);
+		if (!sLoggedNames.insert(nameString).second) {
+			return;
+		}
+	}
+
+	cout << "StyledTextParser: Warning: Could not find style for class '" << narrowString(nameString) << "'" << endl;
+}
+
+static void handleSpanStart(const StringViewType & token, StyledTextParser::SegmentBuilder & builder) {
+	const StringViewType classes = findClassAttribute(token);
+	StyleId styleId = builder.getStyleId();
+
+	const CharType * it = classes.data();
+	const CharType * end = it + classes.size();
+
+	while (it != end) {
+		while (it != end && isSpace(*it)) ++it;
+		const CharType * nameBegin = it;
+		while (it != end && !isSpace(*it)) ++it;
+
+		if (it == nameBegin) break;
 
-		mDefaultTokenParsers[L"<p>"] = tokenParser;
-		mDefaultTokenParsers[L"</p>"] = tokenParser;
+		const StringViewType name(nameBegin, it - nameBegin);
+
+		if (!builder.findStyleClass(name, styleId)) {
+			warnUnknownStyleClass(name);
+		}
 	}
 
-	{
-		// Angled bracket
-		TokenParserFn tokenParser = [](StringType token, const int options, std::vector<StyledText> &segments, std::stack<Style> &styles) {
-			token = L"<";
-			StyledText segment(styles.top(), token);
-			segments.push_back(segment);
-		};
+	builder.pushStyle(styleId);
+}
 
-		mDefaultTokenParsers[L"&lt;"] = tokenParser;
+// Indexed by BuiltInTag. Plain function pointers, so the table is initialized statically and never allocates.
+typedef void (*BuiltInTagHandler)(const StringViewType & token, StyledTextParser::SegmentBuilder & builder);
+
+static const BuiltInTagHandler kBuiltInTagHandlers[] = {
+	nullptr,			// None
+	nullptr,			// Root
+	handleItalicStart,	// ItalicStart
+	handleBoldStart,	// BoldStart
+	handleStyleEnd,		// StyleEnd
+	handleBreak,		// Break
+	handleParagraph,	// Paragraph
+	handleLessThan,		// LessThan
+	handleGreaterThan,	// GreaterThan
+	handleLineBreak,	// LineBreak
+	handleSpanStart,	// SpanStart
+};
+
+// Token parsers operate on a stack of full styles, so the interned style stack is converted for the duration of the call
+static void parseCustomToken(const TokenParserFn & parser, const StringViewType & token, const int options, std::vector<StyledText> & segments, std::vector<StyleId> & styles) {
+	StyleTable & styleTable = *StyleTable::get();
+	std::stack<Style> legacyStyles;
+
+	for (const StyleId id : styles) {
+		legacyStyles.push(styleTable.getStyle(id));
 	}
 
-	{
-		// Angled bracket
-		TokenParserFn tokenParser = [](StringType token, const int options, std::vector<StyledText> &segments, std::stack<Style> &styles) {
-			token = L">";
-			StyledText segment(styles.top(), token);
-			segments.push_back(segment);
-		};
+	parser(StringType(token.data(), token.size()), options, segments, legacyStyles);
 
-		mDefaultTokenParsers[L"&gt;"] = tokenParser;
+	// always keep the base style
+	if (legacyStyles.empty()) {
+		styles.resize(1);
+		return;
 	}
 
-	{
-		// Link break
-		TokenParserFn tokenParser = [](StringType token, const int options, std::vector<StyledText> &segments, std::stack<Style> &styles) {
-			if (options & TRIM_LEADING_BREAKS && segments.empty()) {
-				return;
-			} else {
-				StyledText segment(styles.top(), token);
-				segments.push_back(segment);
-			}
-		};
+	styles.resize(legacyStyles.size());
 
-		mDefaultTokenParsers[L"\n"] = tokenParser;
+	for (auto it = styles.rbegin(); it != styles.rend(); ++it) {
+		*it = styleTable.intern(legacyStyles.top(), styles.front());
+		legacyStyles.pop();
 	}
 }
 
+//==================================================
+// StyledTextParser
+//
+
+StyledTextParser::StyledTextParser() :
+	mTagHandlers(make_shared<TagHandlerMap>()),
+	mCacheCapacity(0),
+	mNumCacheHits(0),
+	mNumCacheMisses(0) {
+	mDefaultOptions = 0;
+}
+
 StyledTextParser::~StyledTextParser() {
 }
 
@@ -134,45 +298,188 @@ std::vector<StyledText> StyledTextParser::parse(const StringType& str, Style bas
 }
 
 std::vector<StyledText> StyledTextParser::parse(const StringType& str, Style baseStyle, int options, const TokenParserMapRef customTokenParsers) {
+	return parse(StringViewType(str), baseStyle, options, customTokenParsers);
+}
+
+std::vector<StyledText> StyledTextParser::parse(const StringViewType& str, Style baseStyle, int options, const TokenParserMapRef customTokenParsers) {
+	if (getCacheCapacity() == 0) {
+		return parseSegments(str, baseStyle, options, customTokenParsers, StyleManager::get()->getStyleClassTable());
+	}
+	return *parseShared(str, baseStyle, options, customTokenParsers);
+}
+
+StyledTextParser::SegmentsRef StyledTextParser::parseShared(const StringViewType& str, Style baseStyle, int options, const TokenParserMapRef customTokenParsers) {
+	const StyleClassTableRef styleClasses = StyleManager::get()->getStyleClassTable();
+
+	if (getCacheCapacity() == 0) {
+		return make_shared<const std::vector<StyledText>>(parseSegments(str, baseStyle, options, customTokenParsers, styleClasses));
+	}
+
+	CacheKey key;
+	key.mTextHash = getTextHash(str);
+	key.mBaseStyleId = StyleTable::get()->intern(baseStyle);
+	key.mOptions = options;
+	key.mCustomTokenParsers = customTokenParsers.get();
+	key.mStyleClasses = styleClasses.get();
+
+	{
+		lock_guard<mutex> lock(mCacheMutex);
+		auto segments = findCachedSegments(key, str);
+
+		if (segments) {
+			++mNumCacheHits;
+			return segments;
+		}
+	}
+
+	// parse outside of the lock so that other threads aren't blocked
+	auto segments = make_shared<const std::vector<StyledText>>(parseSegments(str, baseStyle, options, customTokenParsers, styleClasses));
+
+	lock_guard<mutex> lock(mCacheMutex);
+	++mNumCacheMisses;
+
+	if (mCacheCapacity == 0) {
+		return segments;
+	}
+
+	// another thread might have cached the same text in the meantime
+	if (auto cachedSegments = findCachedSegments(key, str)) {
+		return cachedSegments;
+	}
+
+	CacheEntry entry;
+	entry.mKey = key;
+	entry.mText = StringType(str.data(), str.size());
+	entry.mCustomTokenParsers = customTokenParsers;
+	entry.mStyleClasses = styleClasses;
+	entry.mSegments = segments;
+
+	mCacheEntries.push_front(std::move(entry));
+	mCacheIndex.insert(make_pair(key, mCacheEntries.begin()));
+	trimCache();
+
+	return segments;
+}
+
+StyledTextParser::SegmentsRef StyledTextParser::findCachedSegments(const CacheKey & key, const StringViewType & str) {
+	auto range = mCacheIndex.equal_range(key);
+
+	for (auto it = range.first; it != range.second; ++it) {
+		if (StringViewType(it->second->mText) == str) {
+			// move to front of the LRU list
+			mCacheEntries.splice(mCacheEntries.begin(), mCacheEntries, it->second);
+			return it->second->mSegments;
+		}
+	}
+
+	return nullptr;
+}
+
+void StyledTextParser::setCacheCapacity(const size_t numEntries) {
+	lock_guard<mutex> lock(mCacheMutex);
+	mCacheCapacity = numEntries;
+	trimCache();
+}
+
+void StyledTextParser::clearCache() {
+	lock_guard<mutex> lock(mCacheMutex);
+	mCacheEntries.clear();
+	mCacheIndex.clear();
+}
+
+size_t StyledTextParser::getCacheSize() const {
+	lock_guard<mutex> lock(mCacheMutex);
+	return mCacheEntries.size();
+}
+
+void StyledTextParser::resetCacheStats() {
+	mNumCacheHits = 0;
+	mNumCacheMisses = 0;
+}
+
+void StyledTextParser::trimCache() {
+	while (mCacheEntries.size() > mCacheCapacity) {
+		const auto last = std::prev(mCacheEntries.end());
+		auto range = mCacheIndex.equal_range(last->mKey);
+
+		for (auto it = range.first; it != range.second; ++it) {
+			if (it->second == last) {
+				mCacheIndex.erase(it);
+				break;
+			}
+		}
+
+		mCacheEntries.erase(last);
+	}
+}
+
+size_t StyledTextParser::getTextHash(const StringViewType & str) {
+	// FNV-1a over code units
+	uint64_t hash = 14695981039346656037ULL;
+	for (const CharType c : str) {
+		hash ^= (uint64_t)(std::make_unsigned<CharType>::type)c;
+		hash *= 1099511628211ULL;
+	}
+	return (size_t)hash;
+}
+
+size_t StyledTextParser::CacheKeyHash::operator()(const CacheKey & key) const {
+	// See boost::hash_combine
+	size_t seed = key.mTextHash;
+	seed ^= std::hash<StyleId>()(key.mBaseStyleId) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+	seed ^= std::hash<int>()(key.mOptions) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+	seed ^= std::hash<const void *>()(key.mCustomTokenParsers) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+	seed ^= std::hash<const void *>()(key.mStyleClasses) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+	return seed;
+}
+
+std::vector<StyledText> StyledTextParser::parseSegments(const StringViewType& str, Style baseStyle, int options, const TokenParserMapRef customTokenParsers, const StyleClassTableRef styleClasses, const bool hasPreviousSegments) {
 	std::vector<StyledText> segments;
 
 	try {
-		std::stack<Style> styles;
-		styles.push(baseStyle);
+		ParseState state(baseStyle, options, customTokenParsers, getTagHandlers(), styleClasses);
+		state.mHasPreviousSegments = hasPreviousSegments;
 
-		const StringType& text = options & TRIM_WHITESPACE ? boost::trim_copy(str) : str;
+		const CharType * it = str.data();
+		const CharType * end = it + str.size();
 
-		vector<StringType> tokens = splitStringIntoTokens(L"<root>" + text + L"</root>");
+		if (options & TRIM_WHITESPACE) {
+			while (it != end && isSpace(*it)) ++it;
+			while (end != it && isSpace(*(end - 1))) --end;
+		}
 
-		for (auto& token : tokens) {
-			// Lowercase tag for consistent tag checks
-			const auto tag = boost::to_lower_copy(token);
+		parseToken(state, getRootStartTag(), true, segments);
 
-			// If has macthing custom parser, use it to parse token
-			if (customTokenParsers != nullptr) {
-				const auto iter = customTokenParsers->find(tag);
-				if (iter != customTokenParsers->end()) {
-					iter->second(token, options, segments, styles);
-					continue;
-				}
+		// Single pass over the input: alternate between text runs and tags
+		while (it != end) {
+			const CharType * tagBegin = std::find(it, end, (CharType)'<');
+
+			if (tagBegin != it) {
+				parseToken(state, StringViewType(it, tagBegin - it), false, segments);
 			}
 
-			// Else, if has matching default parser, use it to parse token
-			const auto iter = mDefaultTokenParsers.find(tag);
-			if (iter != mDefaultTokenParsers.end()) {
-				iter->second(token, options, segments, styles);
-				continue;
+			if (tagBegin == end) {
+				break;
 			}
 
-			// Else, use current style to parse token, and add it to segments
-			StyledText segment(styles.top(), token);
-			segments.push_back(segment);
+			const CharType * tagEnd = std::find(tagBegin + 1, end, (CharType)'>');
+
+			if (tagEnd == end) {
+				cout << "StyledTextParser: Warning: Malformed style tag: " << narrowString(StringType(tagBegin, end)) << endl;
+				parseToken(state, StringViewType(tagBegin, end - tagBegin), false, segments);
+				break;
+			}
+
+			parseToken(state, StringViewType(tagBegin, tagEnd + 1 - tagBegin), true, segments);
+			it = tagEnd + 1;
 		}
 
+		parseToken(state, getRootEndTag(), true, segments);
+
 		if (options & TRIM_TRAILING_BREAKS) {
 			while (!segments.empty()) {
 				const auto& segment = segments.back();
-				if (segment.mWText == L"\n") segments.pop_back();
+				if (segment.mWText == BLUECADET_TEXT_STR("\n")) segments.pop_back();
 				else break;
 			}
 		}
@@ -182,36 +489,444 @@ std::vector<StyledText> StyledTextParser::parse(const StringType& str, Style bas
 	}
 
 	if (segments.empty()) {
-		segments.push_back(StyledText(baseStyle, L""));
+		segments.push_back(StyledText(baseStyle, BLUECADET_TEXT_STR("")));
 	}
 
 	return segments;
 }
 
-std::vector<text::StringType> StyledTextParser::splitStringIntoTokens(StringType str) {
-	vector<StringType> tokens;
-	size_t openTagPos = 0, openTagStartSearchPos = 0;
-	while ((openTagPos = str.find_first_of(L"<", openTagStartSearchPos)) != StringType::npos) {
+StyledTextParser::ParseState::ParseState(const Style & baseStyle, const int options, const TokenParserMapRef customTokenParsers, const TagHandlerMapRef tagHandlers, const StyleClassTableRef styleClasses) :
+	mOptions(options),
+	mCustomTokenParsers(customTokenParsers),
+	mTagHandlers(tagHandlers),
+	mStyleClasses(styleClasses),
+	mMaxLookupTextLength(kMaxBuiltInTextTokenLength),
+	mHasPreviousSegments(false) {
+
+	mStyles.push_back(StyleTable::get()->intern(baseStyle));
+
+	// Custom parsers may match plain text tokens, so text tokens up to the longest custom key are looked up as well
+	if (customTokenParsers) {
+		for (const auto & parser : *customTokenParsers) {
+			mMaxLookupTextLength = std::max(mMaxLookupTextLength, parser.first.size());
+		}
+	}
+
+	if (tagHandlers) {
+		for (const auto & handler : *tagHandlers) {
+			mMaxLookupTextLength = std::max(mMaxLookupTextLength, handler.first.size());
+		}
+	}
+}
+
+void StyledTextParser::parseToken(ParseState & state, const StringViewType & token, const bool isTag, std::vector<StyledText> & segments) {
+	if (!isTag && token.size() > state.mMaxLookupTextLength) {
+		segments.push_back(StyledText(state.mStyles.back(), StringType(token.data(), token.size())));
+		return;
+	}
+
+	// Lowercase token for consistent tag checks
+	StringType & lowercaseToken = getLowercaseTokenBuffer();
+	lowercaseToken.assign(token.begin(), token.end());
+	toLowerAscii(lowercaseToken);
+
+	// If has matching custom parser, use it to parse token
+	if (state.mCustomTokenParsers) {
+		const auto iter = state.mCustomTokenParsers->find(lowercaseToken);
+		if (iter != state.mCustomTokenParsers->end()) {
+			parseCustomToken(iter->second, token, state.mOptions, segments, state.mStyles);
+			return;
+		}
+	}
+
+	SegmentBuilder builder(state, segments);
+
+	// Else, if has matching registered tag handler, use it to parse token
+	if (state.mTagHandlers) {
+		const auto iter = state.mTagHandlers->find(lowercaseToken);
+		if (iter != state.mTagHandlers->end()) {
+			iter->second(token, builder);
+			return;
+		}
+	}
+
+	// Else, if has matching built-in tag, use it to parse token
+	const BuiltInTag tag = findBuiltInTag(lowercaseToken.data(), lowercaseToken.size());
+	if (tag != BuiltInTag::None) {
+		const BuiltInTagHandler handler = kBuiltInTagHandlers[(size_t)tag];
+		if (handler) handler(token, builder);
+		return;
+	}
+
+	// Else, use current style to parse token, and add it to segments
+	builder.emitText(token);
+}
+
+const StringViewType & StyledTextParser::getRootStartTag() {
+	// Custom parsers can still hook into the virtual root tag that wraps all text
+	static const StringType tag = BLUECADET_TEXT_STR("<root>");
+	static const StringViewType view(tag);
+	return view;
+}
+
+const StringViewType & StyledTextParser::getRootEndTag() {
+	static const StringType tag = BLUECADET_TEXT_STR("</root>");
+	static const StringViewType view(tag);
+	return view;
+}
+
+std::vector<StringViewType> StyledTextParser::splitParagraphs(const StringViewType& str, int options, const TokenParserMapRef customTokenParsers, const size_t minLength) const {
+	std::vector<StringViewType> paragraphs;
+
+	// custom parsers and handlers might push styles or depend on previous tokens in ways that can't be tracked here
+	const TagHandlerMapRef tagHandlers = getTagHandlers();
 
-		// Get the text that is inbetween the metatags
-		if (openTagStartSearchPos > 0) {
-			StringType tokenString = str.substr(openTagStartSearchPos, openTagPos - openTagStartSearchPos);
-			if (tokenString.size() > 0) tokens.push_back(tokenString);
+	if (customTokenParsers || (tagHandlers && !tagHandlers->empty())) {
+		paragraphs.push_back(str);
+		return paragraphs;
+	}
+
+	const CharType * begin = str.data();
+	const CharType * end = begin + str.size();
+
+	if (options & TRIM_WHITESPACE) {
+		while (begin != end && isSpace(*begin)) ++begin;
+		while (end != begin && isSpace(*(end - 1))) --end;
+	}
+
+	// Paragraphs have to end before the last visible text, so that trailing breaks are always in the last paragraph
+	const CharType * lastContent = nullptr;
+
+	for (const CharType * it = begin; it != end;) {
+		const CharType * tagBegin = std::find(it, end, (CharType)'<');
+		const CharType * tagEnd = tagBegin == end ? end : std::find(tagBegin + 1, end, (CharType)'>');
+		// malformed tags are parsed as text
+		const CharType * textEnd = tagEnd == end ? end : tagBegin;
+
+		for (const CharType * c = it; c != textEnd; ++c) {
+			if (!isSpace(*c)) lastContent = c;
+		}
+
+		it = tagEnd == end ? end : tagEnd + 1;
+	}
+
+	const bool splitAtParagraphTags = !(options & STRIP_PARAGRAPH_TAG);
+	StringType & lowercaseTag = getLowercaseTokenBuffer();
+
+	const CharType * paragraphBegin = begin;
+	size_t depth = 0;
+	bool hasContent = false;	// previous paragraphs have emitted segments, so leading breaks aren't trimmed
+
+	const auto split = [&](const CharType * paragraphEnd) {
+		if (depth != 0 || !hasContent || paragraphEnd > lastContent || (size_t)(paragraphEnd - paragraphBegin) < minLength) {
+			return;
+		}
+		paragraphs.push_back(StringViewType(paragraphBegin, paragraphEnd - paragraphBegin));
+		paragraphBegin = paragraphEnd;
+	};
+
+	for (const CharType * it = begin; it != end;) {
+		const CharType * tagBegin = std::find(it, end, (CharType)'<');
+
+		for (const CharType * c = it; c != tagBegin; ++c) {
+			if (*c == '\n') {
+				// only split before text that's parsed the same way on its own, i.e. that can't match a built-in token
+				const CharType * next = c + 1;
+				if (next != tagBegin && *next != '\n' && (size_t)(tagBegin - next) > kMaxBuiltInTextTokenLength) split(next);
+			} else if (!isSpace(*c)) {
+				hasContent = true;
+			}
 		}
 
-		size_t closeTagPos = 0;
+		if (tagBegin == end) {
+			break;
+		}
 
-		if ((closeTagPos = str.find_first_of(L">", openTagPos + 1)) != StringType::npos) {
+		const CharType * tagEnd = std::find(tagBegin + 1, end, (CharType)'>');
 
-			StringType tokenString = str.substr(openTagPos, closeTagPos - openTagPos + 1);
-			tokens.push_back(tokenString);
-			openTagStartSearchPos = closeTagPos + 1;
-		} else {
-			wcout << L"StyledTextParser: Warning: Malformed style tag: " << str.substr(openTagPos, openTagPos - str.length()) << endl;
+		if (tagEnd == end) {
 			break;
 		}
+
+		lowercaseTag.assign(tagBegin, tagEnd + 1);
+		toLowerAscii(lowercaseTag);
+
+		switch (findBuiltInTag(lowercaseTag.data(), lowercaseTag.size())) {
+			case BuiltInTag::ItalicStart:
+			case BuiltInTag::BoldStart:
+			case BuiltInTag::SpanStart:
+				++depth;
+				break;
+			case BuiltInTag::StyleEnd:
+				if (depth > 0) --depth;
+				break;
+			case BuiltInTag::Paragraph:
+				if (splitAtParagraphTags) split(tagEnd + 1);
+				break;
+			default:
+				break;
+		}
+
+		it = tagEnd + 1;
+	}
+
+	paragraphs.push_back(StringViewType(paragraphBegin, end - paragraphBegin));
+	return paragraphs;
+}
+
+std::vector<StyledText> StyledTextParser::parseParagraph(const std::vector<StringViewType> & paragraphs, const size_t index, Style baseStyle, int options, const TokenParserMapRef customTokenParsers) {
+	if (paragraphs.size() <= 1) {
+		return parse(paragraphs.empty() ? StringViewType() : paragraphs.front(), baseStyle, options, customTokenParsers);
+	}
+
+	// whitespace has been trimmed by splitParagraphs() and trailing breaks can only be in the last paragraph
+	options &= ~TRIM_WHITESPACE;
+
+	if (index + 1 < paragraphs.size()) {
+		options &= ~TRIM_TRAILING_BREAKS;
 	}
-	return tokens;
+
+	return parseSegments(paragraphs[index], baseStyle, options, customTokenParsers, StyleManager::get()->getStyleClassTable(), index > 0);
+}
+
+bool StyledTextParser::parseFile(const ci::fs::path & path, Style baseStyle, int options, const TokenParserMapRef customTokenParsers, const SegmentsCallback & callback, const size_t chunkSize) {
+	MappedFileRef file = MappedFile::create(path);
+
+	if (!file) {
+		cout << "StyledTextParser: Error: Can't map file at '" << path << "'" << endl;
+		return false;
+	}
+
+	const char * it = file->getData();
+	const char * end = it + file->getSize();
+
+	// skip UTF-8 byte order mark
+	if (end - it >= 3 && (unsigned char)it[0] == 0xEF && (unsigned char)it[1] == 0xBB && (unsigned char)it[2] == 0xBF) {
+		it += 3;
+	}
+
+	Stream stream(baseStyle, options, customTokenParsers, this);
+	std::vector<StyledText> segments;
+
+#if !defined(BLUECADET_TEXT_USE_UTF8)
+	StringType chunk;
+#endif
+
+	while (it != end) {
+		const char * chunkEnd = it + std::min((size_t)(end - it), std::max(chunkSize, (size_t)1));
+
+		// don't split multi-byte sequences between chunks
+		while (chunkEnd != end && ((unsigned char)*chunkEnd & 0xC0) == 0x80) {
+			++chunkEnd;
+		}
+
+#if defined(BLUECADET_TEXT_USE_UTF8)
+		// the mapped file is pushed without copying
+		stream.push(StringViewType(it, chunkEnd - it), segments);
+#else
+		chunk.resize(getMaxWideLength(chunkEnd - it));
+		chunk.resize(utf8ToWide(it, chunkEnd - it, &chunk[0]));
+		stream.push(StringViewType(chunk), segments);
+#endif
+
+		if (!segments.empty()) {
+			callback(segments);
+			segments.clear();
+		}
+
+		it = chunkEnd;
+	}
+
+	stream.finish(segments);
+	callback(segments);
+
+	return true;
+}
+
+//==================================================
+// StyledTextParser::Stream
+//
+
+StyledTextParser::Stream::Stream(Style baseStyle, int options, const TokenParserMapRef customTokenParsers, const StyledTextParser * parser) :
+	mState(baseStyle, options, customTokenParsers, (parser ? parser : StyledTextParser::get().get())->getTagHandlers(), StyleManager::get()->getStyleClassTable()),
+	mBaseStyleId(mState.mStyles.front()),
+	mIsPendingTag(false),
+	mHasContent(false),
+	mHasEmittedSegments(false),
+	mIsFinished(false) {
+
+	parseToken(mState, getRootStartTag(), true, mParsedSegments);
+}
+
+StyledTextParser::Stream::~Stream() {
 }
+
+void StyledTextParser::Stream::push(const StringViewType & chunk, std::vector<StyledText> & completedSegments) {
+	if (mIsFinished) {
+		CI_LOG_E("Can't push to a finished stream");
+		return;
+	}
+
+	const CharType * it = chunk.data();
+	const CharType * end = it + chunk.size();
+
+	if ((mState.mOptions & TRIM_WHITESPACE) && !mHasContent) {
+		while (it != end && isSpace(*it)) ++it;
+	}
+
+	mHasContent = mHasContent || it != end;
+
+	while (it != end) {
+		if (mIsPendingTag) {
+			const CharType * tagEnd = std::find(it, end, (CharType)'>');
+
+			if (tagEnd == end) {
+				mPendingText.append(it, end);
+				break;
+			}
+
+			mPendingText.append(it, tagEnd + 1);
+			parseToken(mState, StringViewType(mPendingText), true, mParsedSegments);
+			mPendingText.clear();
+			mIsPendingTag = false;
+			it = tagEnd + 1;
+			continue;
+		}
+
+		const CharType * tagBegin = std::find(it, end, (CharType)'<');
+
+		if (tagBegin == end) {
+			// text might continue in the next chunk
+			mPendingText.append(it, end);
+			break;
+		}
+
+		if (!mPendingText.empty()) {
+			mPendingText.append(it, tagBegin);
+			parseToken(mState, StringViewType(mPendingText), false, mParsedSegments);
+			mPendingText.clear();
+		} else if (tagBegin != it) {
+			parseToken(mState, StringViewType(it, tagBegin - it), false, mParsedSegments);
+		}
+
+		const CharType * tagEnd = std::find(tagBegin + 1, end, (CharType)'>');
+
+		if (tagEnd == end) {
+			// tag continues in the next chunk
+			mPendingText.assign(tagBegin, end);
+			mIsPendingTag = true;
+			break;
+		}
+
+		parseToken(mState, StringViewType(tagBegin, tagEnd + 1 - tagBegin), true, mParsedSegments);
+		it = tagEnd + 1;
+	}
+
+	emitSegments(completedSegments);
+}
+
+void StyledTextParser::Stream::finish(std::vector<StyledText> & completedSegments) {
+	if (mIsFinished) {
+		return;
+	}
+
+	if (mState.mOptions & TRIM_WHITESPACE) {
+		while (!mPendingText.empty() && isSpace(mPendingText.back())) mPendingText.pop_back();
+	}
+
+	if (mIsPendingTag) {
+		cout << "StyledTextParser: Warning: Malformed style tag: " << narrowString(mPendingText) << endl;
+	}
+
+	if (!mPendingText.empty()) {
+		parseToken(mState, StringViewType(mPendingText), false, mParsedSegments);
+		mPendingText.clear();
+	}
+
+	parseToken(mState, getRootEndTag(), true, mParsedSegments);
+	emitSegments(completedSegments);
+
+	// trailing breaks are only held back when they should be trimmed
+	mHeldBackSegments.clear();
+
+	if (!mHasEmittedSegments) {
+		completedSegments.push_back(StyledText(mBaseStyleId, BLUECADET_TEXT_STR("")));
+	}
+
+	mIsFinished = true;
+}
+
+void StyledTextParser::Stream::emitSegments(std::vector<StyledText> & completedSegments) {
+	mState.mHasPreviousSegments = mState.mHasPreviousSegments || !mParsedSegments.empty();
+
+	for (auto & segment : mParsedSegments) {
+		// breaks can only be emitted once it's clear that they aren't trailing
+		if ((mState.mOptions & TRIM_TRAILING_BREAKS) && segment.mWText == BLUECADET_TEXT_STR("\n")) {
+			mHeldBackSegments.push_back(std::move(segment));
+			continue;
+		}
+
+		for (auto & heldBackSegment : mHeldBackSegments) {
+			completedSegments.push_back(std::move(heldBackSegment));
+		}
+
+		mHeldBackSegments.clear();
+		completedSegments.push_back(std::move(segment));
+		mHasEmittedSegments = true;
+	}
+
+	mParsedSegments.clear();
+}
+
+void StyledTextParser::registerTagHandler(const StringType & token, const TagHandlerFn & handler) {
+	{
+		lock_guard<mutex> lock(mTagHandlersMutex);
+		auto handlers = make_shared<TagHandlerMap>(*getTagHandlers());
+		(*handlers)[toLowerAscii(token)] = handler;
+		atomic_store(&mTagHandlers, TagHandlerMapRef(handlers));
+	}
+	clearCache();
+}
+
+void StyledTextParser::unregisterTagHandler(const StringType & token) {
+	{
+		lock_guard<mutex> lock(mTagHandlersMutex);
+		auto handlers = make_shared<TagHandlerMap>(*getTagHandlers());
+		handlers->erase(toLowerAscii(token));
+		atomic_store(&mTagHandlers, TagHandlerMapRef(handlers));
+	}
+	clearCache();
+}
+
+StyledTextParser::TagHandlerMapRef StyledTextParser::getTagHandlers() const {
+	return atomic_load(&mTagHandlers);
+}
+
+//==================================================
+// StyledTextParser::SegmentBuilder
+//
+
+const Style & StyledTextParser::SegmentBuilder::getStyle() const {
+	return StyleTable::get()->getStyle(getStyleId());
+}
+
+void StyledTextParser::SegmentBuilder::pushStyle(const Style & style) {
+	pushStyle(StyleTable::get()->intern(style, getStyleId()));
+}
+
+void StyledTextParser::SegmentBuilder::emitText(const StringViewType & text, const StyleId styleId) {
+	mSegments.push_back(StyledText(styleId, StringType(text.data(), text.size())));
+}
+
+void StyledTextParser::SegmentBuilder::emitBreak() {
+	mSegments.push_back(StyledText(getStyleId(), BLUECADET_TEXT_STR("\n")));
+}
+
+StringType & StyledTextParser::getLowercaseTokenBuffer() {
+	// Reused across calls so that looking up tokens doesn't allocate once the buffer has grown
+	static thread_local StringType buffer;
+	return buffer;
+}
+
 }
 }
@@ -3,15 +3,26 @@
 #include "cinder/app/RendererGl.h"
 #include "cinder/gl/gl.h"
 
+#include <atomic>
+#include <list>
+#include <mutex>
 #include <stack>
+#include <unordered_map>
 
 #include "Text.h"
+#include "StyleClassTable.h"
 
 namespace bluecadet {
 namespace text {
 
 typedef std::shared_ptr<class StyledTextParser> StyledTextParserRef;
 
+//! Parses text with inline style tags into StyledText segments in a single pass. Only tags and short text tokens are
+//! lowercased and looked up. Built-in tags are resolved without any map lookups.
+//! `<span class="name">` tags apply the StyleManager style with that name (see StyleManager::getStyleClassTable()).
+//! Multiple space-separated classes are applied in order, so the last known class wins.
+//! Parse results can optionally be cached (see setCacheCapacity()), which avoids re-parsing identical text.
+//! Thread-safe: parsing doesn't modify any shared state besides the cache, which is guarded by a mutex.
 class StyledTextParser {
 
 public:
@@ -35,15 +46,206 @@ public:
 
 	std::vector<StyledText> parse(const text::StringType& str, Style baseStyle);
 	std::vector<StyledText> parse(const text::StringType& str, Style baseStyle, int options, const TokenParserMapRef customTokenParsers = nullptr);
+	//! Parses a view into existing text without copying it first.
+	std::vector<StyledText> parse(const text::StringViewType& str, Style baseStyle, int options, const TokenParserMapRef customTokenParsers = nullptr);
+
+	typedef std::shared_ptr<const std::vector<StyledText>> SegmentsRef;
+
+	//! Same as parse(), but returns the cached segments without copying them if caching is enabled.
+	SegmentsRef parseShared(const text::StringViewType& str, Style baseStyle, int options, const TokenParserMapRef customTokenParsers = nullptr);
+
+	typedef std::function<void(const std::vector<StyledText> & segments)> SegmentsCallback;
+
+	//! Parses a UTF-8 file in chunks via a memory map, without reading the entire file first. The callback is called
+	//! with segments as soon as they are complete, e.g. to start laying out text while the rest is still parsed.
+	//! Returns false if the file can't be mapped.
+	bool parseFile(const ci::fs::path & path, Style baseStyle, int options, const TokenParserMapRef customTokenParsers, const SegmentsCallback & callback, const size_t chunkSize = 1 << 16);
+
+	//! Splits text after top-level paragraph tags and newlines so that paragraphs can be parsed independently (e.g. on
+	//! multiple threads via parseParagraph()). Paragraphs are only split where no styles are open and are at least
+	//! \a minLength code units long. Returns the entire text as a single paragraph if it can't be split safely, e.g.
+	//! if custom token parsers or registered tag handlers might modify the style stack.
+	std::vector<text::StringViewType> splitParagraphs(const text::StringViewType& str, int options, const TokenParserMapRef customTokenParsers = nullptr, const size_t minLength = 1024) const;
+
+	//! Parses paragraph \a index of the result of splitParagraphs(). Concatenating the segments of all paragraphs
+	//! results in the same text and styles as parse(). Thread-safe, so paragraphs can be parsed concurrently.
+	std::vector<StyledText> parseParagraph(const std::vector<text::StringViewType> & paragraphs, const size_t index, Style baseStyle, int options, const TokenParserMapRef customTokenParsers = nullptr);
+
+	//! Incremental parser for text that arrives in chunks. See below.
+	class Stream;
+
+	//! Passed to tag handlers to emit segments and modify the style stack. See below.
+	class SegmentBuilder;
+
+	//! Handles a single tag or text token without copying it. Tokens are views into the parsed text and are only
+	//! valid for the duration of the call.
+	typedef std::function<void(const text::StringViewType & token, SegmentBuilder & builder)> TagHandlerFn;
+	typedef std::map<text::StringType, TagHandlerFn> TagHandlerMap;
+	typedef std::shared_ptr<const TagHandlerMap> TagHandlerMapRef;
+
+	//! Registers a handler for a token (e.g. "<sup>") that's used by all subsequent parse calls. Tokens are matched
+	//! case-insensitively. Per-call TokenParserMaps take precedence, registered handlers take precedence over
+	//! built-in tags. Clears the parse cache.
+	void registerTagHandler(const text::StringType & token, const TagHandlerFn & handler);
+	void unregisterTagHandler(const text::StringType & token);
+
+	//! Immutable snapshot of all registered tag handlers
+	TagHandlerMapRef getTagHandlers() const;
 
 	int getDefaultOptions() const { return mDefaultOptions; }
 	void setDefaultOptions(const int value) { mDefaultOptions = value; }
 
+	//! Max number of parse results kept in the LRU cache. Results are keyed by text, base style, options and the
+	//! identity of the custom token parser map and StyleManager's style class table, so call clearCache() after
+	//! modifying a map that is in use. Re-parsing StyleManager styles doesn't require clearing the cache.
+	//! Defaults to 0, which disables caching.
+	void setCacheCapacity(const size_t numEntries);
+	size_t getCacheCapacity() const { return mCacheCapacity; }
+	size_t getCacheSize() const;
+	void clearCache();
+
+	//! Number of parse calls that were served from the cache since the last call to resetCacheStats()
+	size_t getNumCacheHits() const { return mNumCacheHits; }
+	//! Number of parse calls that weren't in the cache since the last call to resetCacheStats()
+	size_t getNumCacheMisses() const { return mNumCacheMisses; }
+	void resetCacheStats();
+
 protected:
-	std::vector<text::StringType> splitStringIntoTokens(text::StringType str);
+	//! State of a single parse that's kept between tokens
+	struct ParseState {
+		ParseState(const Style & baseStyle, const int options, const TokenParserMapRef customTokenParsers, const TagHandlerMapRef tagHandlers, const StyleClassTableRef styleClasses);
+		int mOptions;
+		TokenParserMapRef mCustomTokenParsers;
+		TagHandlerMapRef mTagHandlers;
+		StyleClassTableRef mStyleClasses;	//! Snapshot of StyleManager's styles for span tags
+		size_t mMaxLookupTextLength;		//! Longer text tokens can't match any token parser
+		std::vector<StyleId> mStyles;
+		bool mHasPreviousSegments;			//! Whether segments have been emitted from previous chunks
+	};
+
+	//! Parses a single tag or text token. Tags and short text tokens are looked up in the custom and built-in parsers.
+	static void parseToken(ParseState & state, const text::StringViewType & token, const bool isTag, std::vector<StyledText> & segments);
+
+	static const text::StringViewType & getRootStartTag();
+	static const text::StringViewType & getRootEndTag();
+
+	struct CacheKey {
+		size_t mTextHash;
+		StyleId mBaseStyleId;
+		int mOptions;
+		const void * mCustomTokenParsers;
+		const void * mStyleClasses;
+		bool operator==(const CacheKey & rhs) const {
+			return mTextHash == rhs.mTextHash && mBaseStyleId == rhs.mBaseStyleId && mOptions == rhs.mOptions
+				&& mCustomTokenParsers == rhs.mCustomTokenParsers && mStyleClasses == rhs.mStyleClasses;
+		}
+	};
+
+	struct CacheKeyHash {
+		size_t operator()(const CacheKey & key) const;
+	};
+
+	struct CacheEntry {
+		CacheKey mKey;
+		text::StringType mText;						//! Compared on lookup to rule out hash collisions
+		TokenParserMapRef mCustomTokenParsers;		//! Keeps the map alive so its address can't be reused
+		StyleClassTableRef mStyleClasses;			//! Keeps the table alive so its address can't be reused
+		SegmentsRef mSegments;
+	};
+
+	typedef std::list<CacheEntry> CacheEntryList;
+
+	//! hasPreviousSegments is set when parsing a paragraph that follows other paragraphs (see parseParagraph())
+	std::vector<StyledText> parseSegments(const text::StringViewType& str, Style baseStyle, int options, const TokenParserMapRef customTokenParsers, const StyleClassTableRef styleClasses, const bool hasPreviousSegments = false);
+
+	//! Returns the cached segments and marks them as most recently used. Requires mCacheMutex to be locked.
+	SegmentsRef findCachedSegments(const CacheKey & key, const text::StringViewType & str);
+
+	//! Removes least recently used entries until the cache fits its capacity. Requires mCacheMutex to be locked.
+	void trimCache();
 
-	int mDefaultOptions;
-	TokenParserMap mDefaultTokenParsers;
+	static size_t getTextHash(const text::StringViewType & str);
+
+	//! Per-thread scratch string used to lowercase tokens for lookups
+	static text::StringType & getLowercaseTokenBuffer();
+
+	std::atomic<int> mDefaultOptions;
+
+	TagHandlerMapRef mTagHandlers;		//! Replaced atomically when handlers are registered
+	std::mutex mTagHandlersMutex;		//! Serializes registration
+
+	std::atomic<size_t> mCacheCapacity;
+	std::atomic<size_t> mNumCacheHits;
+	std::atomic<size_t> mNumCacheMisses;
+	CacheEntryList mCacheEntries;	//! Most recently used first
+	std::unordered_multimap<CacheKey, CacheEntryList::iterator, CacheKeyHash> mCacheIndex;
+	mutable std::mutex mCacheMutex;
+};
+
+//! Incremental parser that accepts text in chunks and keeps its tag state and style stack between chunks.
+//! Completed segments are the same as parse() would return for the concatenated chunks. Text between two tags is
+//! only emitted once the next tag starts. Custom token parsers only see the segments that haven't been emitted yet.
+class StyledTextParser::Stream {
+public:
+	//! Uses the tag handlers registered with \a parser, or with the shared parser if \a parser is null.
+	Stream(Style baseStyle, int options, const TokenParserMapRef customTokenParsers = nullptr, const StyledTextParser * parser = nullptr);
+	~Stream();
+
+	//! Parses the next chunk and appends all completed segments to \a completedSegments.
+	void push(const text::StringViewType & chunk, std::vector<StyledText> & completedSegments);
+
+	//! Parses any remaining text and appends the final segments to \a completedSegments.
+	void finish(std::vector<StyledText> & completedSegments);
+
+protected:
+	void emitSegments(std::vector<StyledText> & completedSegments);
+
+	ParseState mState;
+	StyleId mBaseStyleId;
+	text::StringType mPendingText;				//! Text or tag that continues in the next chunk
+	std::vector<StyledText> mParsedSegments;
+	std::vector<StyledText> mHeldBackSegments;	//! Breaks that would be trimmed if they're trailing
+	bool mIsPendingTag;
+	bool mHasContent;
+	bool mHasEmittedSegments;
+	bool mIsFinished;
+};
+
+//! Lightweight interface for tag handlers to emit segments and push or pop interned styles on the parser's style stack.
+class StyledTextParser::SegmentBuilder {
+public:
+	SegmentBuilder(ParseState & state, std::vector<StyledText> & segments) : mState(state), mSegments(segments) {}
+
+	//! Parse options passed to StyledTextParser
+	int getOptions() const { return mState.mOptions; }
+
+	//! True if any segments have been emitted so far, including segments from previous chunks when streaming
+	bool hasSegments() const { return mState.mHasPreviousSegments || !mSegments.empty(); }
+
+	//! Current style on top of the style stack
+	StyleId getStyleId() const { return mState.mStyles.back(); }
+	const Style & getStyle() const;
+
+	//! Finds a StyleManager style by name in the snapshot taken when parsing started. Doesn't allocate.
+	bool findStyleClass(const text::StringViewType & name, StyleId & styleId) const { return mState.mStyleClasses && mState.mStyleClasses->find(name, styleId); }
+
+	void pushStyle(const StyleId styleId) { mState.mStyles.push_back(styleId); }
+	//! Interns the style. Prefer the StyleId overload with memoized variants like StyleTable::getBoldId() when possible.
+	void pushStyle(const Style & style);
+
+	//! Pops the current style. The base style is never popped, so unbalanced closing tags are ignored.
+	void popStyle() { if (mState.mStyles.size() > 1) mState.mStyles.pop_back(); }
+
+	//! Emits text with the current style
+	void emitText(const text::StringViewType & text) { emitText(text, getStyleId()); }
+	void emitText(const text::StringViewType & text, const StyleId styleId);
+
+	//! Emits a line break with the current style
+	void emitBreak();
+
+protected:
+	ParseState & mState;
+	std::vector<StyledText> & mSegments;
 };
 
 }
@@ -0,0 +1,72 @@
+#include "SurfacePool.h"
+
+using namespace std;
+
+namespace bluecadet {
+namespace text {
+
+SurfacePool::SurfacePool(size_t maxNumBytes) :
+	mNumBytes(0),
+	mMaxNumBytes(maxNumBytes) {
+}
+
+SurfacePool::~SurfacePool() {
+}
+
+ci::Surface8u SurfacePool::acquire(const ci::ivec2 & size, bool useAlpha, TextBackendRef backend) {
+	{
+		lock_guard<mutex> lock(mMutex);
+		auto bucketIt = mBuckets.find(BucketKey(size.x, size.y, useAlpha));
+
+		if (bucketIt != mBuckets.end()) {
+			auto & surfaces = bucketIt->second;
+
+			for (auto surfaceIt = surfaces.rbegin(); surfaceIt != surfaces.rend(); ++surfaceIt) {
+				if (!backend->isSurfaceCompatible(*surfaceIt)) {
+					continue;
+				}
+				ci::Surface8u surface = *surfaceIt;
+				surfaces.erase(next(surfaceIt).base());
+				mNumBytes -= getNumBytes(surface);
+				return surface;
+			}
+		}
+	}
+
+	return backend->createSurface(size, useAlpha);
+}
+
+void SurfacePool::release(const ci::Surface8u & surface) {
+	if (!surface.getData()) {
+		return;
+	}
+
+	const size_t numBytes = getNumBytes(surface);
+
+	lock_guard<mutex> lock(mMutex);
+
+	if (mNumBytes + numBytes > mMaxNumBytes) {
+		return;
+	}
+
+	mBuckets[BucketKey(surface.getWidth(), surface.getHeight(), surface.hasAlpha())].push_back(surface);
+	mNumBytes += numBytes;
+}
+
+void SurfacePool::clear() {
+	lock_guard<mutex> lock(mMutex);
+	mBuckets.clear();
+	mNumBytes = 0;
+}
+
+size_t SurfacePool::getNumBytes() const {
+	lock_guard<mutex> lock(mMutex);
+	return mNumBytes;
+}
+
+size_t SurfacePool::getNumBytes(const ci::Surface8u & surface) {
+	return (size_t)surface.getRowBytes() * (size_t)surface.getHeight();
+}
+
+}
+}
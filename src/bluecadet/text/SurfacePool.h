@@ -0,0 +1,60 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Surface.h"
+
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+#include "TextBackend.h"
+
+namespace bluecadet {
+namespace text {
+
+typedef std::shared_ptr<class SurfacePool> SurfacePoolRef;
+
+//! Recycles surfaces between renders to avoid re-allocating large pixel buffers every time text changes.
+//! Surfaces are bucketed by size and alpha. Can be shared across multiple StyledTextLayouts and threads.
+class SurfacePool {
+public:
+
+	//! Shared pool instance. Pools are opt-in and need to be assigned to StyledTextLayouts via setSurfacePool().
+	static SurfacePoolRef get() {
+		static auto instance = std::make_shared<SurfacePool>();
+		return instance;
+	}
+
+	//! maxNumBytes limits the total size of all surfaces kept in the pool. Defaults to 64MB.
+	SurfacePool(size_t maxNumBytes = 64 * 1024 * 1024);
+	~SurfacePool();
+
+	//! Returns a pooled surface with the same size and alpha that's compatible with backend, or creates a new one using backend.
+	ci::Surface8u acquire(const ci::ivec2 & size, bool useAlpha, TextBackendRef backend);
+
+	//! Returns a surface to the pool. The surface must no longer be used by the caller. Surfaces are discarded if the pool is full.
+	void release(const ci::Surface8u & surface);
+
+	//! Removes all pooled surfaces.
+	void clear();
+
+	//! Total size in bytes of all surfaces currently in the pool.
+	size_t getNumBytes() const;
+
+	inline size_t getMaxNumBytes() const { return mMaxNumBytes; }
+	inline void setMaxNumBytes(const size_t value) { mMaxNumBytes = value; }
+
+protected:
+	typedef std::tuple<int32_t, int32_t, bool> BucketKey;
+
+	static size_t getNumBytes(const ci::Surface8u & surface);
+
+	std::map<BucketKey, std::vector<ci::Surface8u>> mBuckets;
+	size_t mNumBytes;
+	size_t mMaxNumBytes;
+	mutable std::mutex mMutex;
+};
+
+}
+}
@@ -3,15 +3,25 @@
 #include "cinder/Color.h"
 #include "cinder/Log.h"
 
-#include <codecvt>
+#include "Unicode.h"
+
 #include <cstdint>
+#include <list>
 #include <map>
 #include <stack>
 #include <string>
 #include <sstream> 
 
 #include <boost/algorithm/string.hpp>
-#include <boost/tokenizer.hpp>
+#include <boost/utility/string_ref.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BLUECADET_TEXT_SSE2
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
 
 namespace bluecadet {
 namespace text {
@@ -20,7 +30,22 @@ namespace text {
 // Types
 //
 
+// Define BLUECADET_TEXT_USE_UTF8 to store text as UTF-8 instead of wide strings. Text is only converted to the
+// backend's encoding when measuring and rendering, which typically uses a quarter of the memory of std::wstring on
+// platforms with 4-byte wchar_t.
+#if defined(BLUECADET_TEXT_USE_UTF8)
+typedef std::string StringType;
+//! Expands a string literal to a StringType literal
+#define BLUECADET_TEXT_STR(str) str
+#else
 typedef std::wstring StringType;
+//! Expands a string literal to a StringType literal
+#define BLUECADET_TEXT_STR(str) L##str
+#endif
+
+typedef StringType::value_type CharType;
+//! Non-owning view into a StringType
+typedef boost::basic_string_ref<CharType> StringViewType;
 
 enum TextAlign { Left, Right, Center };
 
@@ -95,10 +120,25 @@ struct Style {
 	bool operator!=(const Style & rhs) const { return !(*this == rhs); }
 };
 
+//! Handle of a style interned in the StyleTable
+typedef uint32_t StyleId;
+
 struct StyledText {
-	Style mStyle;
+	StyleId mStyleId;
+	//! UTF-8 if BLUECADET_TEXT_USE_UTF8 is defined, otherwise wide
 	StringType mWText;
-	StyledText(const Style & style, const StringType & wtext) : mStyle(style), mWText(wtext) {}
+	//! Overrides the color of the interned style if mHasColor is set. Paint-only changes (e.g. animating the color of
+	//! existing text) are stored here so that they don't intern a new style for every color.
+	ci::ColorA mColor;
+	bool mHasColor;
+	//! Interns the style in the StyleTable
+	StyledText(const Style & style, const StringType & wtext);
+	StyledText(const StyleId styleId, const StringType & wtext) : mStyleId(styleId), mWText(wtext), mHasColor(false) {}
+	StyledText(const StyleId styleId, StringType && wtext) : mStyleId(styleId), mWText(std::move(wtext)), mHasColor(false) {}
+	//! Returns the interned style. Its color is ignored if the segment has its own color. Defined in StyleTable.cpp.
+	const Style & getStyle() const;
+	//! Returns the segment's own color if set, otherwise the color of the interned style.
+	const ci::ColorA & getColor() const { return mHasColor ? mColor : getStyle().mColor; }
 };
 
 //==================================================
@@ -218,6 +258,49 @@ inline std::string colorToHexStr(const ci::ColorA & color, const std::string & p
 	return colorToHexStr(ci::ColorA8u(color), prefix);
 }
 
+//==================================================
+// Templates for stl string functions
+//
+
+// Bytes of multi-byte UTF-8 sequences are treated as letters so that words aren't split when transforming UTF-8 text.
+// Only ASCII characters are transformed in UTF-8 text.
+
+inline char isAlpha(const char & c) {
+	return (unsigned char)c >= 0x80 || std::isalpha((unsigned char)c) != 0;
+}
+inline wchar_t isAlpha(const wchar_t & c) {
+	return std::iswalpha(c) != 0;
+}
+
+inline char isAlNum(const char & c) {
+	return (unsigned char)c >= 0x80 || std::isalnum((unsigned char)c) != 0;
+}
+inline wchar_t isAlNum(const wchar_t & c) {
+	return std::iswalnum(c) != 0;
+}
+
+inline char isPunct(const char & c) {
+	return std::ispunct((unsigned char)c) != 0;
+}
+
+inline wchar_t isPunct(const wchar_t & c) {
+	return std::iswpunct(c) != 0;
+}
+
+inline bool isSpace(const char c) {
+	return std::isspace((unsigned char)c) != 0;
+}
+inline bool isSpace(const wchar_t c) {
+	return std::iswspace(c) != 0;
+}
+
+inline char toUpper(const char c) {
+	return (unsigned char)c >= 0x80 ? c : (char)std::toupper((unsigned char)c);
+}
+inline wchar_t toUpper(const wchar_t c) {
+	return std::towupper(c);
+}
+
 //==================================================
 // Text helpers
 //
@@ -225,12 +308,22 @@ inline std::string colorToHexStr(const ci::ColorA & color, const std::string & p
 //! Splits a string into tokens based on delimiters. All delimiters are returned as tokens themselves.
 template <typename StringType, typename ContainerType>
 inline void tokenize(const StringType & str, ContainerType & tokenContainer, const StringType & delimiters) {
-	typedef typename StringType::value_type CharType;
-	typedef boost::tokenizer<boost::char_separator<wchar_t>, typename StringType::const_iterator, StringType> tokenizer;
-	boost::char_separator<wchar_t> sep{StringType().c_str(), delimiters.c_str()};
-	tokenizer tok{str, sep};
-	for (const auto & t : tok) {
-		tokenContainer.push_back(t);
+	typedef typename StringType::size_type SizeType;
+	SizeType tokenStart = 0;
+
+	for (SizeType i = 0; i < str.length(); ++i) {
+		if (delimiters.find(str[i]) == StringType::npos) {
+			continue;
+		}
+		if (i > tokenStart) {
+			tokenContainer.push_back(str.substr(tokenStart, i - tokenStart));
+		}
+		tokenContainer.push_back(str.substr(i, 1));
+		tokenStart = i + 1;
+	}
+
+	if (str.length() > tokenStart) {
+		tokenContainer.push_back(str.substr(tokenStart));
 	}
 }
 
@@ -238,16 +331,103 @@ inline void tokenize(const StringType & str, ContainerType & tokenContainer, con
 template <typename StringType>
 inline std::list<StringType> tokenize(const StringType & str, const StringType & delimiters) {
 	std::list<StringType> tokenContainer;
-	typedef typename StringType::value_type CharType;
-	typedef boost::tokenizer<boost::char_separator<wchar_t>, typename StringType::const_iterator, StringType> tokenizer;
-	boost::char_separator<wchar_t> sep{StringType().c_str(), delimiters.c_str()};
-	tokenizer tok{str, sep};
-	for (const auto & t : tok) {
-		tokenContainer.push_back(t);
-	}
+	tokenize(str, tokenContainer, delimiters);
 	return tokenContainer;
 }
 
+//! Classification of tokens returned by tokenizeWords().
+enum class TokenType { Word, Whitespace, Newline };
+
+//! A single token that references the tokenized text without copying it.
+struct TokenView {
+	StringViewType	mText;
+	TokenType		mType;
+};
+
+inline int countTrailingZeros(const uint32_t value) {
+#if defined(_MSC_VER)
+	unsigned long index = 0;
+	_BitScanForward(&index, value);
+	return (int)index;
+#else
+	return __builtin_ctz(value);
+#endif
+}
+
+//! Returns a pointer to the first space, tab or newline in [begin, end) or end if there is none. Compares 16 bytes at a time when SSE2 is available.
+inline const CharType * findWordDelimiter(const CharType * begin, const CharType * end) {
+	const CharType * it = begin;
+
+#if defined(BLUECADET_TEXT_SSE2)
+	const ptrdiff_t numCharsPerBlock = 16 / sizeof(CharType);
+
+	while (end - it >= numCharsPerBlock) {
+		const __m128i block = _mm_loadu_si128((const __m128i *)it);
+		__m128i matches;
+
+		if (sizeof(CharType) == 1) {
+			matches = _mm_or_si128(_mm_or_si128(
+				_mm_cmpeq_epi8(block, _mm_set1_epi8(' ')),
+				_mm_cmpeq_epi8(block, _mm_set1_epi8('\n'))),
+				_mm_cmpeq_epi8(block, _mm_set1_epi8('\t')));
+		} else if (sizeof(CharType) == 2) {
+			matches = _mm_or_si128(_mm_or_si128(
+				_mm_cmpeq_epi16(block, _mm_set1_epi16(' ')),
+				_mm_cmpeq_epi16(block, _mm_set1_epi16('\n'))),
+				_mm_cmpeq_epi16(block, _mm_set1_epi16('\t')));
+		} else {
+			matches = _mm_or_si128(_mm_or_si128(
+				_mm_cmpeq_epi32(block, _mm_set1_epi32(' ')),
+				_mm_cmpeq_epi32(block, _mm_set1_epi32('\n'))),
+				_mm_cmpeq_epi32(block, _mm_set1_epi32('\t')));
+		}
+
+		const uint32_t mask = (uint32_t)_mm_movemask_epi8(matches);
+
+		if (mask != 0) {
+			return it + countTrailingZeros(mask) / sizeof(CharType);
+		}
+
+		it += numCharsPerBlock;
+	}
+#endif
+
+	for (; it != end; ++it) {
+		const CharType c = *it;
+		if (c == ' ' || c == '\n' || c == '\t') {
+			return it;
+		}
+	}
+
+	return end;
+}
+
+//! Splits text into word, whitespace and newline tokens in a single pass without copying any text. Spaces, tabs and
+//! newlines are returned as single-character tokens, matching tokenize(text, BLUECADET_TEXT_STR(" \n\t")). Tokens are classified by their
+//! first character.
+template <typename ContainerType>
+inline void tokenizeWords(const StringViewType & text, ContainerType & tokens) {
+	const CharType * it = text.data();
+	const CharType * end = it + text.size();
+
+	while (it != end) {
+		const CharType * delimiter = findWordDelimiter(it, end);
+
+		if (delimiter != it) {
+			const TokenType type = isSpace(*it) ? TokenType::Whitespace : TokenType::Word;
+			tokens.push_back(TokenView{StringViewType(it, delimiter - it), type});
+		}
+
+		if (delimiter == end) {
+			break;
+		}
+
+		const TokenType type = *delimiter == '\n' ? TokenType::Newline : TokenType::Whitespace;
+		tokens.push_back(TokenView{StringViewType(delimiter, 1), type});
+		it = delimiter + 1;
+	}
+}
+
 //! Joins a list of strings with a join character.
 template <typename StringType, typename ContainerType>
 StringType join(const ContainerType & items, StringType & delimiter = ".") {
@@ -277,28 +457,11 @@ template <typename StringType> inline const auto split(const StringType & s, cha
 	return split<StringType, std::vector<StringType>>(s, delimiter);
 }
 
-//! Transforms text case. Returns a copy of the original text.
-template <typename StringType> inline StringType transform(const StringType & text, const TextTransform transform) {
-	switch (transform) {
-		case TextTransform::None:
-			return text;
-			// using boost::locale is better for international case conversion, but not included in default cinder boost
-			// build
-			/*case TextTransform::Uppercase: run->append(boost::locale::to_upper(token)); break;
-			case TextTransform::Lowercase: run->append(boost::locale::to_lower(token)); break;
-			case TextTransform::Capitalize: run->append(boost::locale::to_title(token)); break;*/
-		case TextTransform::Uppercase: return boost::algorithm::to_upper_copy(text);
-		case TextTransform::Lowercase: return boost::algorithm::to_lower_copy(text);
-		case TextTransform::Capitalize: return capitalize(text);
-		default: return text;
-	}
-}
-
 template <typename StringType> inline StringType capitalize(const StringType & text) {
 	StringType result(text);
 	bool isWordCapped = false;
 
-	for (int i = 0; i < result.length(); ++i) {
+	for (size_t i = 0; i < result.length(); ++i) {
 		const auto c = result[i];
 
 		if (!isAlpha(c)) {
@@ -314,80 +477,102 @@ template <typename StringType> inline StringType capitalize(const StringType & t
 	return result;
 }
 
+//! Transforms text case. Returns a copy of the original text.
+template <typename StringType> inline StringType transform(const StringType & text, const TextTransform transform) {
+	switch (transform) {
+		case TextTransform::None:
+			return text;
+			// using boost::locale is better for international case conversion, but not included in default cinder boost
+			// build
+			/*case TextTransform::Uppercase: run->append(boost::locale::to_upper(token)); break;
+			case TextTransform::Lowercase: run->append(boost::locale::to_lower(token)); break;
+			case TextTransform::Capitalize: run->append(boost::locale::to_title(token)); break;*/
+		case TextTransform::Uppercase: return boost::algorithm::to_upper_copy(text);
+		case TextTransform::Lowercase: return boost::algorithm::to_lower_copy(text);
+		case TextTransform::Capitalize: return capitalize(text);
+		default: return text;
+	}
+}
+
 //==================================================
-// Templates for stl string functions
+// String type conversion
 //
 
-inline char isAlpha(const char & c) {
-	return std::isalpha(c) != 0;
-}
-inline wchar_t isAlpha(const wchar_t & c) {
-	return std::iswalpha(c) != 0;
-}
+// Backed by the validating SIMD transcoder in Unicode.h. Safe to call from multiple threads.
 
-inline char isAlNum(const char & c) {
-	return std::isalnum(c) != 0;
-}
-inline wchar_t isAlNum(const wchar_t & c) {
-	return std::iswalnum(c) != 0;
+inline std::u16string u16String(const std::string & narrow_utf8_source_string) {
+	std::u16string result(getMaxUtf16Length(narrow_utf8_source_string.size()), u'\0');
+	result.resize(utf8ToUtf16(narrow_utf8_source_string.data(), narrow_utf8_source_string.size(), &result[0]));
+	return result;
 }
 
-inline char isPunct(const char & c) {
-	return std::ispunct(c) != 0;
+//! Converts UTF-8 to wide text in \a result, reusing its capacity.
+inline void wideString(const std::string & narrow_utf8_source_string, std::wstring & result) {
+	result.resize(getMaxWideLength(narrow_utf8_source_string.size()));
+	result.resize(utf8ToWide(narrow_utf8_source_string.data(), narrow_utf8_source_string.size(), &result[0]));
 }
 
-inline wchar_t isPunct(const wchar_t & c) {
-	return std::iswpunct(c) != 0;
+inline std::wstring wideString(const std::string & narrow_utf8_source_string) {
+	std::wstring result;
+	wideString(narrow_utf8_source_string, result);
+	return result;
 }
 
-inline bool isSpace(const char c) {
-	return std::isspace(c) != 0;
-}
-inline bool isSpace(const wchar_t c) {
-	return std::iswspace(c) != 0;
+//! Converts wide text to UTF-8 in \a result, reusing its capacity.
+inline void narrowString(const std::wstring & wide_source_string, std::string & result) {
+	result.resize(getMaxUtf8LengthFromWide(wide_source_string.size()));
+	result.resize(wideToUtf8(wide_source_string.data(), wide_source_string.size(), &result[0]));
 }
 
-inline char toUpper(const char c) {
-	return std::toupper(c);
-}
-inline wchar_t toUpper(const wchar_t c) {
-	return std::towupper(c);
+inline std::string narrowString(const std::wstring & wide_source_string) {
+	std::string result;
+	narrowString(wide_source_string, result);
+	return result;
 }
 
-//==================================================
-// String type conversion
-//
-
-inline std::u16string u16String(const std::string & narrow_utf8_source_string) {
-	static std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t> converter;
-	return converter.from_bytes(narrow_utf8_source_string);
+inline std::string narrowString(const std::u16string & wide_utf16_source_string) {
+	std::string result(getMaxUtf8LengthFromUtf16(wide_utf16_source_string.size()), '\0');
+	result.resize(utf16ToUtf8(wide_utf16_source_string.data(), wide_utf16_source_string.size(), &result[0]));
+	return result;
 }
 
-inline std::wstring wideString(const std::string & narrow_utf8_source_string) {
-	static std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>, wchar_t> converter;
-	return converter.from_bytes(narrow_utf8_source_string);
+//! Pass-through overloads so that StringType can be converted regardless of its encoding.
+inline const std::wstring & wideString(const std::wstring & wide_source_string) {
+	return wide_source_string;
 }
 
-inline std::string narrowString(const std::wstring & wide_source_string) {
-	static std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>, wchar_t> converter;
-	return converter.to_bytes(wide_source_string);
+inline const std::string & narrowString(const std::string & narrow_utf8_source_string) {
+	return narrow_utf8_source_string;
 }
 
-inline std::string narrowString(const std::u16string & wide_utf16_source_string) {
-	static std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t> converter;
-	return converter.to_bytes(wide_utf16_source_string);
+//! Converts UTF-8 or wide text to StringType. No copy is made if the text already is a StringType.
+#if defined(BLUECADET_TEXT_USE_UTF8)
+inline const StringType & toStringType(const std::string & text) {
+	return text;
+}
+inline StringType toStringType(const std::wstring & text) {
+	return narrowString(text);
+}
+#else
+inline StringType toStringType(const std::string & text) {
+	return wideString(text);
+}
+inline const StringType & toStringType(const std::wstring & text) {
+	return text;
 }
+#endif
 
 //==================================================
 // Token parser definition used by StyledTextParser
 //
 
 // Define token parsers according to this signature. Process token. Modify segments or styles if needed.
+// The parser tracks styles as interned StyleIds, so the style stack is converted before and after each call.
 typedef std::function<void(StringType token, const int options, std::vector<StyledText> & segments,
 						   std::stack<Style> & styles)>
 	TokenParserFn;
 
-typedef std::map<std::wstring, TokenParserFn> TokenParserMap;
+typedef std::map<StringType, TokenParserFn> TokenParserMap;
 typedef std::shared_ptr<TokenParserMap> TokenParserMapRef;
 
 }  // namespace text
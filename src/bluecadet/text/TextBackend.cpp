@@ -0,0 +1,73 @@
+#include "TextBackend.h"
+
+#include <algorithm>
+
+#if defined(CINDER_MSW)
+#include "GdiPlusTextBackend.h"
+#else
+#include "FreeTypeTextBackend.h"
+#endif
+
+namespace bluecadet {
+namespace text {
+
+TextBackendRef TextBackend::getDefault() {
+#if defined(CINDER_MSW)
+	static TextBackendRef instance = std::make_shared<GdiPlusTextBackend>();
+#else
+	static TextBackendRef instance = std::make_shared<FreeTypeTextBackend>();
+#endif
+	return instance;
+}
+
+TextBackend::TextBackend() :
+	mAdvanceCache(this) {
+}
+
+TextBackend::FontMetrics TextBackend::getFontMetrics(const ci::Font & font) {
+	FontMetrics metrics;
+	metrics.mAscent = font.getAscent();
+	metrics.mDescent = font.getDescent();
+	metrics.mLeading = font.getLeading();
+	return metrics;
+}
+
+const void * TextBackend::getFontHandle(const ci::Font & font) {
+#if defined(CINDER_MSW)
+	return font.getGdiplusFont();
+#else
+	return font.getFreetypeFace();
+#endif
+}
+
+ci::Surface8u TextBackend::createSurface(const ci::ivec2 & size, bool useAlpha) {
+	return ci::Surface8u(size.x, size.y, useAlpha);
+}
+
+void TextBackend::renderCoverage(ci::Channel8u & channel, const std::vector<DrawCommand> & commands) {
+	std::vector<DrawCommand> whiteCommands(commands);
+	for (auto & command : whiteCommands) {
+		command.mColor = ci::ColorA::white();
+	}
+
+	ci::Surface8u surface = createSurface(channel.getSize(), true);
+	surface.setPremultiplied(false);
+	renderText(surface, whiteCommands, ci::ColorA8u(0, 0, 0, 0));
+
+	const int32_t width = std::min(channel.getWidth(), surface.getWidth());
+	const int32_t height = std::min(channel.getHeight(), surface.getHeight());
+	const uint8_t alphaOffset = surface.getAlphaOffset();
+	const uint8_t pixelInc = surface.getPixelInc();
+
+	for (int32_t y = 0; y < height; ++y) {
+		const uint8_t * src = surface.getData() + y * surface.getRowBytes() + alphaOffset;
+		uint8_t * dst = channel.getData() + y * channel.getRowBytes();
+
+		for (int32_t x = 0; x < width; ++x) {
+			dst[x * channel.getIncrement()] = src[x * pixelInc];
+		}
+	}
+}
+
+}
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Font.h"
+#include "cinder/Surface.h"
+#include "cinder/Channel.h"
+
+#include <vector>
+
+#include "Text.h"
+#include "WordAdvanceCache.h"
+
+namespace bluecadet {
+namespace text {
+
+typedef std::shared_ptr<class TextBackend> TextBackendRef;
+
+//! Abstracts font measurement and rasterization away from StyledTextLayout.
+//! StyledTextLayout only computes line breaks and positions; all platform-specific font APIs live in a backend.
+class TextBackend {
+public:
+
+	//! Vertical font metrics in pixels.
+	struct FontMetrics {
+		float mAscent = 0.0f;
+		float mDescent = 0.0f;
+		float mLeading = 0.0f;
+	};
+
+	//! A single run of text with uniform font and color. The origin is the top-left corner of the run's line box and size is the measured size of the run.
+	struct DrawCommand {
+		StringType	mText;
+		ci::Font	mFont;
+		ci::ColorA	mColor;
+		ci::vec2	mOrigin;
+		ci::vec2	mSize;
+	};
+
+	//! Returns the shared default backend for the current platform. GDI+ on Windows, FreeType everywhere else.
+	static TextBackendRef getDefault();
+
+	TextBackend();
+	virtual ~TextBackend() {}
+
+	//! Returns the advance (x) and line height (y) of a run of text, including trailing whitespace and kerning.
+	virtual ci::vec2 measureText(const StringType & text, const ci::Font & font) = 0;
+
+	//! Returns the vertical metrics of a font. Defaults to the metrics reported by ci::Font.
+	virtual FontMetrics getFontMetrics(const ci::Font & font);
+
+	//! Identifies the native face that font resolved to (e.g. its FT_Face or Gdiplus::Font). Fonts that share a display name
+	//! but differ in weight or style have different handles. Used to key per-font caches.
+	virtual const void * getFontHandle(const ci::Font & font);
+
+	//! Creates a surface that satisfies the pixel layout requirements of renderText().
+	virtual ci::Surface8u createSurface(const ci::ivec2 & size, bool useAlpha);
+
+	//! Clears the channel and draws the 8-bit coverage of all commands into it, ignoring their colors.
+	//! The default implementation renders opaque white text into a temporary surface via renderText() and copies its alpha channel.
+	virtual void renderCoverage(ci::Channel8u & channel, const std::vector<DrawCommand> & commands);
+
+	//! Returns true if renderText() can draw into surface (e.g. a caller-provided surface with a specific channel order). Defaults to true.
+	virtual bool isSurfaceCompatible(const ci::Surface8u & /*surface*/) { return true; }
+
+	//! Clears the surface with clearColor and draws all commands into it in order.
+	virtual void renderText(ci::Surface8u & surface, const std::vector<DrawCommand> & commands, const ci::ColorA8u & clearColor) = 0;
+
+	//! Cached token advances measured with this backend. Used by StyledTextLayout for line breaking.
+	inline WordAdvanceCache & getAdvanceCache() { return mAdvanceCache; }
+
+protected:
+	WordAdvanceCache mAdvanceCache;
+};
+
+}
+}
@@ -0,0 +1,209 @@
+#include "Unicode.h"
+#include "Text.h"
+
+namespace bluecadet {
+namespace text {
+
+//==================================================
+// Encoding helpers
+//
+
+static inline char * encodeUtf8(const uint32_t c, char * dst) {
+	if (c < 0x80) {
+		*dst++ = (char)c;
+	} else if (c < 0x800) {
+		*dst++ = (char)(0xC0 | (c >> 6));
+		*dst++ = (char)(0x80 | (c & 0x3F));
+	} else if (c < 0x10000) {
+		*dst++ = (char)(0xE0 | (c >> 12));
+		*dst++ = (char)(0x80 | ((c >> 6) & 0x3F));
+		*dst++ = (char)(0x80 | (c & 0x3F));
+	} else {
+		*dst++ = (char)(0xF0 | (c >> 18));
+		*dst++ = (char)(0x80 | ((c >> 12) & 0x3F));
+		*dst++ = (char)(0x80 | ((c >> 6) & 0x3F));
+		*dst++ = (char)(0x80 | (c & 0x3F));
+	}
+	return dst;
+}
+
+static inline char16_t * encodeUtf16(const uint32_t c, char16_t * dst) {
+	if (c < 0x10000) {
+		*dst++ = (char16_t)c;
+	} else {
+		*dst++ = (char16_t)(0xD800 + ((c - 0x10000) >> 10));
+		*dst++ = (char16_t)(0xDC00 + ((c - 0x10000) & 0x3FF));
+	}
+	return dst;
+}
+
+//==================================================
+// UTF-8 to UTF-16/32
+//
+
+size_t utf8ToUtf16(const char * src, size_t numUnits, char16_t * dst) {
+	const char * it = src;
+	const char * end = src + numUnits;
+	char16_t * out = dst;
+
+	while (it != end) {
+		if ((unsigned char)*it >= 0x80) {
+			out = encodeUtf16(nextCodePoint(it, end), out);
+			continue;
+		}
+
+#if defined(BLUECADET_TEXT_SSE2)
+		// zero-extend blocks of 16 ASCII bytes
+		const __m128i zero = _mm_setzero_si128();
+
+		while (end - it >= 16) {
+			const __m128i block = _mm_loadu_si128((const __m128i *)it);
+			if (_mm_movemask_epi8(block) != 0) break;
+			_mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi8(block, zero));
+			_mm_storeu_si128((__m128i *)(out + 8), _mm_unpackhi_epi8(block, zero));
+			it += 16;
+			out += 16;
+		}
+#endif
+
+		while (it != end && (unsigned char)*it < 0x80) {
+			*out++ = (char16_t)*it++;
+		}
+	}
+
+	return out - dst;
+}
+
+size_t utf8ToUtf32(const char * src, size_t numUnits, char32_t * dst) {
+	const char * it = src;
+	const char * end = src + numUnits;
+	char32_t * out = dst;
+
+	while (it != end) {
+		if ((unsigned char)*it >= 0x80) {
+			*out++ = (char32_t)nextCodePoint(it, end);
+			continue;
+		}
+
+#if defined(BLUECADET_TEXT_SSE2)
+		// zero-extend blocks of 16 ASCII bytes
+		const __m128i zero = _mm_setzero_si128();
+
+		while (end - it >= 16) {
+			const __m128i block = _mm_loadu_si128((const __m128i *)it);
+			if (_mm_movemask_epi8(block) != 0) break;
+			const __m128i lo = _mm_unpacklo_epi8(block, zero);
+			const __m128i hi = _mm_unpackhi_epi8(block, zero);
+			_mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi16(lo, zero));
+			_mm_storeu_si128((__m128i *)(out + 4), _mm_unpackhi_epi16(lo, zero));
+			_mm_storeu_si128((__m128i *)(out + 8), _mm_unpacklo_epi16(hi, zero));
+			_mm_storeu_si128((__m128i *)(out + 12), _mm_unpackhi_epi16(hi, zero));
+			it += 16;
+			out += 16;
+		}
+#endif
+
+		while (it != end && (unsigned char)*it < 0x80) {
+			*out++ = (char32_t)*it++;
+		}
+	}
+
+	return out - dst;
+}
+
+//==================================================
+// UTF-16/32 to UTF-8
+//
+
+size_t utf16ToUtf8(const char16_t * src, size_t numUnits, char * dst) {
+	const char16_t * it = src;
+	const char16_t * end = src + numUnits;
+	char * out = dst;
+
+	while (it != end) {
+		if (*it >= 0x80) {
+			out = encodeUtf8(nextCodePoint(it, end), out);
+			continue;
+		}
+
+#if defined(BLUECADET_TEXT_SSE2)
+		// narrow blocks of 16 ASCII units
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i nonAsciiMask = _mm_set1_epi16((short)0xFF80);
+
+		while (end - it >= 16) {
+			const __m128i a = _mm_loadu_si128((const __m128i *)it);
+			const __m128i b = _mm_loadu_si128((const __m128i *)(it + 8));
+			const __m128i nonAscii = _mm_and_si128(_mm_or_si128(a, b), nonAsciiMask);
+			if (_mm_movemask_epi8(_mm_cmpeq_epi16(nonAscii, zero)) != 0xFFFF) break;
+			_mm_storeu_si128((__m128i *)out, _mm_packus_epi16(a, b));
+			it += 16;
+			out += 16;
+		}
+#endif
+
+		while (it != end && *it < 0x80) {
+			*out++ = (char)*it++;
+		}
+	}
+
+	return out - dst;
+}
+
+size_t utf32ToUtf8(const char32_t * src, size_t numUnits, char * dst) {
+	const char32_t * it = src;
+	const char32_t * end = src + numUnits;
+	char * out = dst;
+
+	while (it != end) {
+		if (*it >= 0x80) {
+			out = encodeUtf8(nextCodePoint(it, end), out);
+			continue;
+		}
+
+#if defined(BLUECADET_TEXT_SSE2)
+		// narrow blocks of 16 ASCII units
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i nonAsciiMask = _mm_set1_epi32((int)0xFFFFFF80);
+
+		while (end - it >= 16) {
+			const __m128i a = _mm_loadu_si128((const __m128i *)it);
+			const __m128i b = _mm_loadu_si128((const __m128i *)(it + 4));
+			const __m128i c = _mm_loadu_si128((const __m128i *)(it + 8));
+			const __m128i d = _mm_loadu_si128((const __m128i *)(it + 12));
+			const __m128i nonAscii = _mm_and_si128(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)), nonAsciiMask);
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(nonAscii, zero)) != 0xFFFF) break;
+			_mm_storeu_si128((__m128i *)out, _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+			it += 16;
+			out += 16;
+		}
+#endif
+
+		while (it != end && *it < 0x80) {
+			*out++ = (char)*it++;
+		}
+	}
+
+	return out - dst;
+}
+
+//==================================================
+// wchar_t
+//
+
+size_t utf8ToWide(const char * src, size_t numUnits, wchar_t * dst) {
+	if (sizeof(wchar_t) == 2) {
+		return utf8ToUtf16(src, numUnits, reinterpret_cast<char16_t *>(dst));
+	}
+	return utf8ToUtf32(src, numUnits, reinterpret_cast<char32_t *>(dst));
+}
+
+size_t wideToUtf8(const wchar_t * src, size_t numUnits, char * dst) {
+	if (sizeof(wchar_t) == 2) {
+		return utf16ToUtf8(reinterpret_cast<const char16_t *>(src), numUnits, dst);
+	}
+	return utf32ToUtf8(reinterpret_cast<const char32_t *>(src), numUnits, dst);
+}
+
+}
+}
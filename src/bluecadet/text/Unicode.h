@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace bluecadet {
+namespace text {
+
+//==================================================
+// Unicode transcoding
+//
+// Validating UTF-8 <-> UTF-16/UTF-32 conversion. Runs of ASCII characters are converted 16 at a time when SSE2 is
+// available. Invalid or truncated sequences, overlong encodings, unpaired surrogates and code points above U+10FFFF
+// are replaced with U+FFFD.
+//
+// All functions write into a caller-provided buffer that must hold at least as many code units as returned by the
+// matching getMax*Length() function and return the number of code units written. No null terminator is written.
+//
+
+//! Replacement character for invalid input
+const uint32_t kReplacementCodePoint = 0xFFFD;
+
+//! Max number of UTF-16 code units needed to transcode numUtf8Units of UTF-8
+inline size_t getMaxUtf16Length(const size_t numUtf8Units) { return numUtf8Units; }
+//! Max number of UTF-32 code units needed to transcode numUtf8Units of UTF-8
+inline size_t getMaxUtf32Length(const size_t numUtf8Units) { return numUtf8Units; }
+//! Max number of UTF-8 code units needed to transcode numUtf16Units of UTF-16
+inline size_t getMaxUtf8LengthFromUtf16(const size_t numUtf16Units) { return numUtf16Units * 3; }
+//! Max number of UTF-8 code units needed to transcode numUtf32Units of UTF-32
+inline size_t getMaxUtf8LengthFromUtf32(const size_t numUtf32Units) { return numUtf32Units * 4; }
+//! Max number of wchar_t code units needed to transcode numUtf8Units of UTF-8
+inline size_t getMaxWideLength(const size_t numUtf8Units) { return numUtf8Units; }
+//! Max number of UTF-8 code units needed to transcode numWideUnits of wchar_t
+inline size_t getMaxUtf8LengthFromWide(const size_t numWideUnits) {
+	return sizeof(wchar_t) == 2 ? getMaxUtf8LengthFromUtf16(numWideUnits) : getMaxUtf8LengthFromUtf32(numWideUnits);
+}
+
+size_t utf8ToUtf16(const char * src, size_t numUnits, char16_t * dst);
+size_t utf8ToUtf32(const char * src, size_t numUnits, char32_t * dst);
+size_t utf16ToUtf8(const char16_t * src, size_t numUnits, char * dst);
+size_t utf32ToUtf8(const char32_t * src, size_t numUnits, char * dst);
+
+//! UTF-16 on platforms with 2-byte wchar_t (Windows), UTF-32 everywhere else
+size_t utf8ToWide(const char * src, size_t numUnits, wchar_t * dst);
+//! UTF-16 on platforms with 2-byte wchar_t (Windows), UTF-32 everywhere else
+size_t wideToUtf8(const wchar_t * src, size_t numUnits, char * dst);
+
+//==================================================
+// Code point decoding
+//
+
+//! Decodes the UTF-8 sequence at \a it and advances \a it past it.
+inline uint32_t nextCodePoint(const char *& it, const char * end) {
+	uint32_t c = (unsigned char)*it++;
+
+	if (c < 0x80) return c;
+
+	int numTrailing = 0;
+	uint32_t minValue = 0;
+
+	if ((c & 0xE0) == 0xC0) {
+		numTrailing = 1;
+		minValue = 0x80;
+		c &= 0x1F;
+	} else if ((c & 0xF0) == 0xE0) {
+		numTrailing = 2;
+		minValue = 0x800;
+		c &= 0x0F;
+	} else if ((c & 0xF8) == 0xF0) {
+		numTrailing = 3;
+		minValue = 0x10000;
+		c &= 0x07;
+	} else {
+		return kReplacementCodePoint;
+	}
+
+	for (int i = 0; i < numTrailing; ++i) {
+		if (it == end || ((unsigned char)*it & 0xC0) != 0x80) return kReplacementCodePoint;
+		c = (c << 6) | ((unsigned char)*it++ & 0x3F);
+	}
+
+	if (c < minValue || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) return kReplacementCodePoint;
+	return c;
+}
+
+//! Decodes the UTF-16 unit or surrogate pair at \a it and advances \a it past it.
+inline uint32_t nextCodePoint(const char16_t *& it, const char16_t * end) {
+	const uint32_t c = *it++;
+
+	if (c < 0xD800 || c > 0xDFFF) return c;
+	if (c >= 0xDC00 || it == end) return kReplacementCodePoint;
+
+	const uint32_t low = *it;
+	if (low < 0xDC00 || low > 0xDFFF) return kReplacementCodePoint;
+
+	++it;
+	return 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+}
+
+//! Decodes the UTF-32 unit at \a it and advances \a it past it.
+inline uint32_t nextCodePoint(const char32_t *& it, const char32_t * /*end*/) {
+	const uint32_t c = *it++;
+	if (c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) return kReplacementCodePoint;
+	return c;
+}
+
+//! Decodes UTF-16 on platforms with 2-byte wchar_t (Windows) and UTF-32 everywhere else.
+inline uint32_t nextCodePoint(const wchar_t *& it, const wchar_t * end) {
+	if (sizeof(wchar_t) == 2) {
+		const char16_t * it16 = reinterpret_cast<const char16_t *>(it);
+		const uint32_t c = nextCodePoint(it16, reinterpret_cast<const char16_t *>(end));
+		it = reinterpret_cast<const wchar_t *>(it16);
+		return c;
+	}
+
+	const char32_t * it32 = reinterpret_cast<const char32_t *>(it);
+	const uint32_t c = nextCodePoint(it32, reinterpret_cast<const char32_t *>(end));
+	it = reinterpret_cast<const wchar_t *>(it32);
+	return c;
+}
+
+}
+}
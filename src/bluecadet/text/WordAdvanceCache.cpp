@@ -0,0 +1,96 @@
+#include "WordAdvanceCache.h"
+#include "TextBackend.h"
+
+using namespace std;
+
+namespace bluecadet {
+namespace text {
+
+//==================================================
+// FontAdvances
+//
+
+WordAdvanceCache::FontAdvances::FontAdvances(const ci::Font & font, TextBackend * backend, size_t maxNumEntries) :
+	mFont(font),
+	mBackend(backend),
+	mMaxNumEntries(maxNumEntries) {
+}
+
+float WordAdvanceCache::FontAdvances::getAdvance(const StringType & token) {
+	return getAdvance(token.data(), token.length());
+}
+
+float WordAdvanceCache::FontAdvances::getAdvance(const CharType * text, const size_t length) {
+	{
+		lock_guard<mutex> lock(mMutex);
+		mLookupKey.assign(text, length);
+		auto advanceIt = mAdvances.find(mLookupKey);
+
+		if (advanceIt != mAdvances.end()) {
+			return advanceIt->second;
+		}
+	}
+
+	const StringType token(text, length);
+
+	// measure without holding the lock; concurrent misses of the same token measure the same value
+	const float advance = mBackend->measureText(token, mFont).x;
+
+	lock_guard<mutex> lock(mMutex);
+
+	if (mAdvances.size() >= mMaxNumEntries) {
+		mAdvances.clear();
+	}
+
+	mAdvances[token] = advance;
+	return advance;
+}
+
+size_t WordAdvanceCache::FontAdvances::getNumEntries() const {
+	lock_guard<mutex> lock(mMutex);
+	return mAdvances.size();
+}
+
+//==================================================
+// WordAdvanceCache
+//
+
+WordAdvanceCache::WordAdvanceCache(TextBackend * backend, size_t maxNumEntriesPerFont, size_t maxNumFonts) :
+	mBackend(backend),
+	mMaxNumEntriesPerFont(maxNumEntriesPerFont),
+	mMaxNumFonts(maxNumFonts) {
+}
+
+WordAdvanceCache::~WordAdvanceCache() {
+}
+
+WordAdvanceCache::FontAdvancesRef WordAdvanceCache::getFontAdvances(const ci::Font & font) {
+	const FontKey key(mBackend->getFontHandle(font), font.getSize());
+	lock_guard<mutex> lock(mMutex);
+	auto fontIt = mFonts.find(key);
+
+	if (fontIt != mFonts.end()) {
+		return fontIt->second;
+	}
+
+	if (mFonts.size() >= mMaxNumFonts) {
+		// existing refs stay valid, they're just no longer shared
+		mFonts.clear();
+	}
+
+	auto advances = make_shared<FontAdvances>(font, mBackend, mMaxNumEntriesPerFont);
+	mFonts[key] = advances;
+	return advances;
+}
+
+float WordAdvanceCache::getAdvance(const StringType & token, const ci::Font & font) {
+	return getFontAdvances(font)->getAdvance(token);
+}
+
+void WordAdvanceCache::clear() {
+	lock_guard<mutex> lock(mMutex);
+	mFonts.clear();
+}
+
+}
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Font.h"
+
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+#include "Text.h"
+
+namespace bluecadet {
+namespace text {
+
+class TextBackend;
+
+typedef std::shared_ptr<class WordAdvanceCache> WordAdvanceCacheRef;
+
+//! Bounded cache of token advances keyed by resolved font and token. Used during line breaking so that each distinct word is
+//! only measured once per font instead of re-measuring the entire run every time a word is appended.
+//! Thread-safe: tokens are measured outside of locks, so multiple threads can measure different words concurrently.
+class WordAdvanceCache {
+public:
+
+	//! Cached advances of a single font. Hold on to an instance while measuring many tokens of the same font to avoid
+	//! repeated font lookups.
+	class FontAdvances {
+	public:
+		FontAdvances(const ci::Font & font, TextBackend * backend, size_t maxNumEntries);
+
+		//! Returns the advance of token, measuring it with the backend if it isn't cached yet.
+		float getAdvance(const StringType & token);
+
+		//! Returns the advance of a token in a larger buffer. Doesn't allocate if the token is cached already.
+		float getAdvance(const CharType * token, const size_t length);
+
+		inline const ci::Font & getFont() const { return mFont; }
+		size_t getNumEntries() const;
+
+	protected:
+		ci::Font mFont;
+		TextBackend * mBackend;
+		size_t mMaxNumEntries;
+		std::unordered_map<StringType, float> mAdvances;
+		StringType mLookupKey;	//! Reused key for lookups of tokens that aren't strings
+		mutable std::mutex mMutex;
+	};
+	typedef std::shared_ptr<FontAdvances> FontAdvancesRef;
+
+	//! Measurements are delegated to backend, which must outlive this cache.
+	WordAdvanceCache(TextBackend * backend, size_t maxNumEntriesPerFont = 8192, size_t maxNumFonts = 128);
+	~WordAdvanceCache();
+
+	//! Returns the cached advances for font. Creates a new, empty cache for fonts that haven't been used yet.
+	FontAdvancesRef getFontAdvances(const ci::Font & font);
+
+	//! Shortcut to measure a single token. Prefer getFontAdvances() when measuring multiple tokens of the same font.
+	float getAdvance(const StringType & token, const ci::Font & font);
+
+	//! Removes all cached advances. Should be called when fonts are reloaded or the font scale changes.
+	void clear();
+
+	//! Max number of tokens cached per font. Once reached, the font's cache is cleared and refilled. Defaults to 8192.
+	inline size_t getMaxNumEntriesPerFont() const { return mMaxNumEntriesPerFont; }
+	inline void setMaxNumEntriesPerFont(const size_t value) { mMaxNumEntriesPerFont = value; }
+
+	//! Max number of fonts cached. Once reached, all fonts are cleared. Defaults to 128.
+	inline size_t getMaxNumFonts() const { return mMaxNumFonts; }
+	inline void setMaxNumFonts(const size_t value) { mMaxNumFonts = value; }
+
+protected:
+	//! Native font handle and size. Names aren't unique since regular, bold and italic faces often share one.
+	typedef std::pair<const void *, float> FontKey;
+
+	TextBackend * mBackend;
+	size_t mMaxNumEntriesPerFont;
+	size_t mMaxNumFonts;
+	std::map<FontKey, FontAdvancesRef> mFonts;
+	std::mutex mMutex;
+};
+
+}
+}
@@ -0,0 +1,155 @@
+#include "WorkerPool.h"
+
+using namespace std;
+
+namespace bluecadet {
+namespace text {
+
+// Set while a thread runs tasks to execute nested parallelFor() calls inline
+static thread_local bool sIsRunningTask = false;
+
+WorkerPool::WorkerPool(size_t numThreads) :
+	mTaskId(0),
+	mIsStopping(false) {
+
+	if (numThreads == 0) {
+		const size_t hardwareThreads = (size_t)thread::hardware_concurrency();
+		numThreads = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+	}
+
+	for (size_t i = 0; i < numThreads; ++i) {
+		mThreads.push_back(thread(&WorkerPool::workerLoop, this));
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		lock_guard<mutex> lock(mMutex);
+		mIsStopping = true;
+	}
+
+	mTaskCondition.notify_all();
+
+	for (auto & thread : mThreads) {
+		thread.join();
+	}
+}
+
+void WorkerPool::parallelFor(const size_t count, const std::function<void(size_t)> & fn) {
+	if (count == 0) {
+		return;
+	}
+
+	if (mThreads.empty() || count == 1 || sIsRunningTask) {
+		for (size_t i = 0; i < count; ++i) {
+			fn(i);
+		}
+		return;
+	}
+
+	lock_guard<mutex> submitLock(mSubmitMutex);
+	auto task = make_shared<Task>(fn, count);
+
+	{
+		lock_guard<mutex> lock(mMutex);
+		mTask = task;
+		++mTaskId;
+	}
+
+	mTaskCondition.notify_all();
+
+	// calling thread helps out until all indices are claimed
+	sIsRunningTask = true;
+	runTask(*task);
+	sIsRunningTask = false;
+
+	{
+		unique_lock<mutex> lock(mMutex);
+		mDoneCondition.wait(lock, [&] { return task->mNumCompleted == task->mCount; });
+		mTask = nullptr;
+	}
+
+	if (task->mException) {
+		rethrow_exception(task->mException);
+	}
+}
+
+void WorkerPool::submit(std::function<void()> job) {
+	if (mThreads.empty()) {
+		runJob(job);
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(mMutex);
+		mJobs.push_back(std::move(job));
+	}
+
+	mTaskCondition.notify_one();
+}
+
+void WorkerPool::workerLoop() {
+	sIsRunningTask = true;
+	size_t lastTaskId = 0;
+
+	while (true) {
+		shared_ptr<Task> task;
+		function<void()> job;
+
+		{
+			unique_lock<mutex> lock(mMutex);
+			mTaskCondition.wait(lock, [&] { return mIsStopping || (mTask && mTaskId != lastTaskId) || !mJobs.empty(); });
+
+			if (mTask && mTaskId != lastTaskId) {
+				// parallelFor() blocks its caller, so its tasks take priority over queued jobs
+				lastTaskId = mTaskId;
+				task = mTask;
+
+			} else if (!mJobs.empty()) {
+				job = std::move(mJobs.front());
+				mJobs.pop_front();
+
+			} else {
+				// stopping and all queued jobs are done
+				return;
+			}
+		}
+
+		if (task) {
+			runTask(*task);
+		} else {
+			runJob(job);
+		}
+	}
+}
+
+void WorkerPool::runJob(const std::function<void()> & job) {
+	try {
+		job();
+	} catch (...) {
+		// jobs report their own errors (e.g. via std::packaged_task)
+	}
+}
+
+void WorkerPool::runTask(Task & task) {
+	size_t index = 0;
+
+	while ((index = task.mNextIndex++) < task.mCount) {
+		try {
+			task.mFn(index);
+		} catch (...) {
+			lock_guard<mutex> lock(mMutex);
+			if (!task.mException) {
+				task.mException = current_exception();
+			}
+		}
+
+		if (++task.mNumCompleted == task.mCount) {
+			lock_guard<mutex> lock(mMutex);
+			mDoneCondition.notify_all();
+		}
+	}
+}
+
+}
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace bluecadet {
+namespace text {
+
+typedef std::shared_ptr<class WorkerPool> WorkerPoolRef;
+
+//! Persistent pool of worker threads used to process independent text jobs in parallel.
+//! Work is distributed dynamically: each thread claims the next unprocessed index, so uneven jobs balance out.
+//! Single jobs can also be queued without blocking via submit().
+class WorkerPool {
+public:
+
+	//! Shared pool with one thread per hardware thread (the calling thread participates as well).
+	static WorkerPoolRef get() {
+		static auto instance = std::make_shared<WorkerPool>();
+		return instance;
+	}
+
+	//! numThreads defaults to the number of hardware threads minus one.
+	WorkerPool(size_t numThreads = 0);
+	~WorkerPool();
+
+	//! Calls fn(i) for every i in [0, count) across all workers and the calling thread, then blocks until all calls
+	//! have returned. Concurrent calls are serialized; nested calls from within fn run inline.
+	//! Rethrows the first exception thrown by fn.
+	void parallelFor(const size_t count, const std::function<void(size_t)> & fn);
+
+	//! Queues job to run on one of the worker threads and returns immediately. Jobs run in submission order whenever
+	//! no parallelFor() task is pending. Runs job inline if the pool has no threads. Exceptions thrown by job are discarded.
+	//! Queued jobs are completed before the pool is destroyed.
+	void submit(std::function<void()> job);
+
+	inline size_t getNumThreads() const { return mThreads.size(); }
+
+protected:
+	struct Task {
+		Task(const std::function<void(size_t)> & fn, const size_t count) : mFn(fn), mCount(count), mNextIndex(0), mNumCompleted(0) {}
+		const std::function<void(size_t)> & mFn;
+		const size_t mCount;
+		std::atomic<size_t> mNextIndex;
+		std::atomic<size_t> mNumCompleted;
+		std::exception_ptr mException;
+	};
+
+	void workerLoop();
+	void runTask(Task & task);
+	void runJob(const std::function<void()> & job);
+
+	std::vector<std::thread> mThreads;
+	std::mutex mSubmitMutex;
+	std::mutex mMutex;
+	std::condition_variable mTaskCondition;
+	std::condition_variable mDoneCondition;
+	std::shared_ptr<Task> mTask;
+	std::deque<std::function<void()>> mJobs;
+	size_t mTaskId;
+	bool mIsStopping;
+};
+
+}
+}